@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+
+
+// Runs jobs on one background thread in the order they're submitted. At most max_jobs can be waiting or running
+// at once: reserve() blocks the caller until there is room, which bounds the memory held by pending jobs.
+class AsyncWriter {
+public:
+
+  AsyncWriter(int max_jobs) : max_jobs(max_jobs) , pending(0) , done(false) {
+    thread = std::thread( [this] () { run(); } );
+  }
+
+
+  ~AsyncWriter() {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      done = true;
+    }
+    cv.notify_all();
+    thread.join();
+  }
+
+
+  // Wait until another job can be submitted. Since jobs finish in order, this also means the job submitted
+  // max_jobs submissions ago is finished with whatever it used.
+  void reserve() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait( lock , [this] () { return pending < max_jobs; } );
+  }
+
+
+  void submit(std::function<void()> job) {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait( lock , [this] () { return pending < max_jobs; } );
+      jobs.push_back(job);
+      pending++;
+    }
+    cv.notify_all();
+  }
+
+
+  // Wait until every submitted job has finished
+  void wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait( lock , [this] () { return pending == 0; } );
+  }
+
+
+private:
+
+  void run() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait( lock , [this] () { return done || ! jobs.empty(); } );
+        if (jobs.empty()) { return; }
+        job = jobs.front();
+        jobs.pop_front();
+      }
+      job();
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        pending--;
+      }
+      cv.notify_all();
+    }
+  }
+
+  int                               max_jobs;
+  int                               pending;   // Jobs waiting or running
+  bool                              done;
+  std::deque<std::function<void()>> jobs;
+  std::mutex                        mtx;
+  std::condition_variable           cv;
+  std::thread                       thread;
+};
@@ -0,0 +1,340 @@
+
+#pragma once
+
+#include "const.h"
+#include "Timers.h"
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// Checkpoint and restart of a model through raw binary files. Each rank's checkpoint holds a small header with
+// the run's counters and everything else the time stepping depends on (the direction switch of the dimensional
+// splitting, the lake's surface level, and the initial masses finalize() compares against), followed by the
+// state with its halos, the bathymetry, the bathymetry's GLL values, and any envelope statistics accumulated so
+// far, exactly as they are in memory. The
+// temporal operators keep nothing between time steps, so a restarted run is bitwise identical to the one that
+// wrote the checkpoint. By default each rank writes and maps its own file, with the rank inserted before the
+// extension (e.g., ckpt.bin -> ckpt.r00003.bin). In collective mode, all ranks share one file through MPI-IO
+// instead. A restart needs the same build and the same decomposition as the run that wrote the checkpoint. Its
+// outputs continue the output file from the checkpoint's time, overwriting any the first run wrote after it.
+template <class Spatial>
+class Checkpoint {
+public:
+
+  typedef Temporal_operator<Spatial> Model;
+
+  int static constexpr version = 2;
+
+  // Counters of the driver's time loop, saved with the model
+  struct Counters {
+    real_acc etime;
+    int      nstep;
+    int      num_out;
+  };
+
+  struct Header {
+    char      magic[8];
+    int       version;
+    int       real_size;
+    int       ord;
+    int       ngll;
+    int       num_state;
+    int       hs;
+    int       nx;
+    int       ny;
+    long long i_beg;
+    long long j_beg;
+    int       dimsplit;
+    int       dim_switch;
+    int       nstep;
+    int       num_out;
+    double    etime;
+    double    surf_level;
+    double    mass_init;
+    double    tracer_mass_init[Spatial::num_tracers_arr];
+    int       envelope;        // 0 without envelope statistics, 1 with them, and 2 with their moments too
+    double    envelope_etime;
+  };
+
+
+  // File name with a tag inserted before the extension, e.g., (test.nc , m003) -> test.m003.nc
+  static std::string file_with_tag(std::string file, std::string tag) {
+    size_t dot   = file.find_last_of('.');
+    size_t slash = file.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && slash > dot)) { return file + "." + tag; }
+    return file.substr(0,dot) + "." + tag + file.substr(dot);
+  }
+
+
+  static std::string rank_file(Spatial const &space_op, std::string file, bool collective) {
+    if (! space_op.use_mpi || collective) { return file; }
+    char tag[16];
+    snprintf(tag,16,"r%05d",space_op.myrank);
+    return file_with_tag(file,tag);
+  }
+
+
+  // Write the checkpoint of one model. It goes to a temporary file first, so a failure part of the way through
+  // leaves the previous checkpoint intact.
+  static void write(Model const &model, real3d const &state, std::string file, bool collective, Counters counters) {
+    TIMER_START("checkpoint");
+    Spatial const &space_op = model.space_op;
+    std::vector<char> buf;
+    pack( space_op , state , counters , buf );
+
+    std::string fname = rank_file(space_op,file,collective);
+    std::string tmp   = fname + ".tmp";
+    if (collective) {
+      #ifdef __ENABLE_MPI__
+        write_collective( tmp , buf );
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (space_op.masterproc) {
+          if (rename( tmp.c_str() , fname.c_str() ) != 0) { endrun("ERROR: Couldn't rename the checkpoint file"); }
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+      #else
+        endrun("ERROR: Collective checkpoints require MPI");
+      #endif
+    } else {
+      FILE *fp = fopen( tmp.c_str() , "wb" );
+      if (fp == nullptr) { endrun("ERROR: Couldn't open the checkpoint file for writing"); }
+      if (fwrite( buf.data() , 1 , buf.size() , fp ) != buf.size()) { endrun("ERROR: Couldn't write the checkpoint file"); }
+      if (fclose(fp) != 0) { endrun("ERROR: Couldn't write the checkpoint file"); }
+      if (rename( tmp.c_str() , fname.c_str() ) != 0) { endrun("ERROR: Couldn't rename the checkpoint file"); }
+    }
+    TIMER_STOP("checkpoint");
+  }
+
+
+  // Restore a model from its checkpoint in place of init_state(), returning the driver's counters. Per-rank
+  // files are mapped into memory and copied straight into the model's arrays.
+  static Counters read(Model &model, real3d &state, std::string file, bool collective) {
+    Spatial &space_op = model.space_op;
+    std::string fname = rank_file(space_op,file,collective);
+    Counters counters;
+    if (collective) {
+      #ifdef __ENABLE_MPI__
+        std::vector<char> buf;
+        read_collective( fname , checkpoint_size(space_op,state) , buf );
+        counters = unpack( space_op , state , buf.data() , buf.size() );
+      #else
+        endrun("ERROR: Collective checkpoints require MPI");
+      #endif
+    } else {
+      int fd = open( fname.c_str() , O_RDONLY );
+      if (fd < 0) { endrun("ERROR: Couldn't open the checkpoint file for reading"); }
+      struct stat st;
+      if (fstat(fd,&st) != 0) { endrun("ERROR: Couldn't stat the checkpoint file"); }
+      size_t size = st.st_size;
+      if (size < sizeof(Header)) { endrun("ERROR: The checkpoint file is truncated"); }
+      void *map = mmap( nullptr , size , PROT_READ , MAP_PRIVATE , fd , 0 );
+      if (map == MAP_FAILED) { endrun("ERROR: Couldn't map the checkpoint file"); }
+      counters = unpack( space_op , state , (char const *) map , size );
+      munmap( map , size );
+      close( fd );
+    }
+    return counters;
+  }
+
+
+  static size_t checkpoint_size(Spatial const &space_op, real3d const &state) {
+    size_t size = sizeof(Header) + ( state.totElems() + space_op.bath.totElems() ) * sizeof(real);
+    if (space_op.dimsplit) {
+      size += ( space_op.bath_gll_x.totElems() + space_op.bath_gll_y.totElems() ) * sizeof(real);
+    } else {
+      size += space_op.bath_gll.totElems() * sizeof(real);
+    }
+    if (envelope_flag(space_op) > 0) {
+      size += 3 * space_op.envelope.surf_max.totElems() * sizeof(real);
+      if (space_op.envelope.moments) { size += space_op.envelope.stats.totElems() * sizeof(real_acc); }
+    }
+    return size;
+  }
+
+
+  static int envelope_flag(Spatial const &space_op) {
+    if (space_op.envelope.file.empty()) { return 0; }
+    return space_op.envelope.moments ? 2 : 1;
+  }
+
+
+  static void pack(Spatial const &space_op, real3d const &state, Counters counters, std::vector<char> &buf) {
+    Header hdr;
+    std::memset( &hdr , 0 , sizeof(Header) );
+    std::memcpy( hdr.magic , "AWFLCKPT" , 8 );
+    hdr.version    = version;
+    hdr.real_size  = sizeof(real);
+    hdr.ord        = ord;
+    hdr.ngll       = ngll;
+    hdr.num_state  = Spatial::num_state;
+    hdr.hs         = Spatial::hs;
+    hdr.nx         = space_op.nx;
+    hdr.ny         = space_op.ny;
+    hdr.i_beg      = space_op.i_beg;
+    hdr.j_beg      = space_op.j_beg;
+    hdr.dimsplit   = space_op.dimsplit;
+    hdr.dim_switch = space_op.dim_switch;
+    hdr.nstep      = counters.nstep;
+    hdr.num_out    = counters.num_out;
+    hdr.etime      = counters.etime;
+    hdr.surf_level = space_op.surf_level;
+    hdr.mass_init  = space_op.mass_init;
+    for (int tr=0; tr < num_tracers; tr++) { hdr.tracer_mass_init[tr] = space_op.tracer_mass_init[tr]; }
+    hdr.envelope       = envelope_flag(space_op);
+    hdr.envelope_etime = space_op.envelope.etime;
+
+    buf.resize( checkpoint_size(space_op,state) );
+    size_t pos = 0;
+    std::memcpy( buf.data() , &hdr , sizeof(Header) );
+    pos += sizeof(Header);
+    pack_array( state          , buf , pos );
+    pack_array( space_op.bath  , buf , pos );
+    if (space_op.dimsplit) {
+      pack_array( space_op.bath_gll_x , buf , pos );
+      pack_array( space_op.bath_gll_y , buf , pos );
+    } else {
+      pack_array( space_op.bath_gll   , buf , pos );
+    }
+    if (hdr.envelope > 0) {
+      pack_array( space_op.envelope.surf_max  , buf , pos );
+      pack_array( space_op.envelope.speed_max , buf , pos );
+      pack_array( space_op.envelope.arrival   , buf , pos );
+      if (hdr.envelope > 1) { pack_array( space_op.envelope.stats , buf , pos ); }
+    }
+  }
+
+
+  static Counters unpack(Spatial &space_op, real3d &state, char const *buf, size_t size) {
+    Header hdr;
+    std::memcpy( &hdr , buf , sizeof(Header) );
+    if (std::memcmp( hdr.magic , "AWFLCKPT" , 8 ) != 0 || hdr.version != version) {
+      endrun("ERROR: Not a checkpoint file, or one from an incompatible version");
+    }
+    if (hdr.real_size != sizeof(real) || hdr.ord != ord || hdr.ngll != ngll || hdr.num_state != Spatial::num_state ||
+        hdr.hs != Spatial::hs || hdr.dimsplit != (int) space_op.dimsplit || hdr.envelope != envelope_flag(space_op)) {
+      endrun("ERROR: The checkpoint was written by a differently built or configured model");
+    }
+    if (hdr.nx != space_op.nx || hdr.ny != space_op.ny ||
+        hdr.i_beg != (long long) space_op.i_beg || hdr.j_beg != (long long) space_op.j_beg) {
+      endrun("ERROR: The checkpoint was written with a different domain decomposition");
+    }
+    if (size != checkpoint_size(space_op,state)) { endrun("ERROR: The checkpoint file has the wrong size"); }
+
+    space_op.dim_switch = hdr.dim_switch;
+    space_op.surf_level = hdr.surf_level;
+    space_op.mass_init  = hdr.mass_init;
+    space_op.tracer_mass_init = std::vector<real_acc>(num_tracers);
+    for (int tr=0; tr < num_tracers; tr++) { space_op.tracer_mass_init[tr] = hdr.tracer_mass_init[tr]; }
+    space_op.envelope.etime = hdr.envelope_etime;
+
+    size_t pos = sizeof(Header);
+    unpack_array( state         , buf , pos );
+    unpack_array( space_op.bath , buf , pos );
+    if (space_op.dimsplit) {
+      unpack_array( space_op.bath_gll_x , buf , pos );
+      unpack_array( space_op.bath_gll_y , buf , pos );
+    } else {
+      unpack_array( space_op.bath_gll   , buf , pos );
+    }
+    if (hdr.envelope > 0) {
+      unpack_array( space_op.envelope.surf_max  , buf , pos );
+      unpack_array( space_op.envelope.speed_max , buf , pos );
+      unpack_array( space_op.envelope.arrival   , buf , pos );
+      if (hdr.envelope > 1) { unpack_array( space_op.envelope.stats , buf , pos ); }
+    }
+
+    space_op.restart_output( hdr.etime , hdr.num_out , hdr.nstep );
+
+    Counters counters;
+    counters.etime   = hdr.etime;
+    counters.nstep   = hdr.nstep;
+    counters.num_out = hdr.num_out;
+    return counters;
+  }
+
+
+  template <class ARR> static void pack_array(ARR const &arr, std::vector<char> &buf, size_t &pos) {
+    auto host = arr.createHostCopy();
+    size_t bytes = host.totElems() * sizeof(*host.data());
+    std::memcpy( buf.data() + pos , host.data() , bytes );
+    pos += bytes;
+  }
+
+
+  template <class ARR> static void unpack_array(ARR &arr, char const *buf, size_t &pos) {
+    auto host = arr.createHostCopy();
+    size_t bytes = host.totElems() * sizeof(*host.data());
+    std::memcpy( host.data() , buf + pos , bytes );
+    host.deep_copy_to(arr);
+    pos += bytes;
+  }
+
+
+  #ifdef __ENABLE_MPI__
+    // Ranks write their checkpoints one after another in a shared file, in rank order
+    static MPI_Offset collective_offset(size_t size) {
+      long long mysize = size;
+      long long offset = 0;
+      int myrank;
+      MPI_Comm_rank( MPI_COMM_WORLD , &myrank );
+      MPI_Exscan( &mysize , &offset , 1 , MPI_LONG_LONG , MPI_SUM , MPI_COMM_WORLD );
+      if (myrank == 0) { offset = 0; }
+      return offset;
+    }
+
+
+    // Number of MPI-IO calls every rank takes part in, since each call's count is an int
+    static long long collective_chunks(size_t size, size_t chunk) {
+      long long nchunks = (size + chunk - 1) / chunk;
+      MPI_Allreduce( MPI_IN_PLACE , &nchunks , 1 , MPI_LONG_LONG , MPI_MAX , MPI_COMM_WORLD );
+      return nchunks;
+    }
+
+
+    static void write_collective(std::string fname, std::vector<char> const &buf) {
+      size_t     chunk   = 1 << 30;
+      MPI_Offset offset  = collective_offset( buf.size() );
+      long long  nchunks = collective_chunks( buf.size() , chunk );
+      MPI_File fh;
+      if (MPI_File_open( MPI_COMM_WORLD , fname.c_str() , MPI_MODE_CREATE | MPI_MODE_WRONLY ,
+                         MPI_INFO_NULL , &fh ) != MPI_SUCCESS) {
+        endrun("ERROR: Couldn't open the checkpoint file for writing");
+      }
+      for (long long c=0; c < nchunks; c++) {
+        size_t beg   = std::min( (size_t) c*chunk , buf.size() );
+        int    count = std::min( chunk , buf.size() - beg );
+        if (MPI_File_write_at_all( fh , offset+beg , buf.data()+beg , count , MPI_BYTE ,
+                                   MPI_STATUS_IGNORE ) != MPI_SUCCESS) {
+          endrun("ERROR: Couldn't write the checkpoint file");
+        }
+      }
+      MPI_File_close( &fh );
+    }
+
+
+    static void read_collective(std::string fname, size_t size, std::vector<char> &buf) {
+      size_t     chunk   = 1 << 30;
+      MPI_Offset offset  = collective_offset( size );
+      long long  nchunks = collective_chunks( size , chunk );
+      buf.resize( size );
+      MPI_File fh;
+      if (MPI_File_open( MPI_COMM_WORLD , fname.c_str() , MPI_MODE_RDONLY , MPI_INFO_NULL , &fh ) != MPI_SUCCESS) {
+        endrun("ERROR: Couldn't open the checkpoint file for reading");
+      }
+      for (long long c=0; c < nchunks; c++) {
+        size_t beg   = std::min( (size_t) c*chunk , size );
+        int    count = std::min( chunk , size - beg );
+        if (MPI_File_read_at_all( fh , offset+beg , buf.data()+beg , count , MPI_BYTE ,
+                                  MPI_STATUS_IGNORE ) != MPI_SUCCESS) {
+          endrun("ERROR: Couldn't read the checkpoint file");
+        }
+      }
+      MPI_File_close( &fh );
+    }
+  #endif
+
+};
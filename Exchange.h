@@ -2,6 +2,7 @@
 #pragma once
 
 #include "const.h"
+#include "Timers.h"
 
 
 class Exchange {
@@ -80,6 +81,20 @@ public:
   }
 
 
+  // Seconds this process has spent waiting on other ranks, in every Exchange's halos and edges and in the
+  // model's reductions, which the driver reports as the load imbalance
+  static double &wait_time() {
+    static double seconds = 0;
+    return seconds;
+  }
+
+
+  // Add the time since begin to the wait time
+  static void add_wait(std::chrono::steady_clock::time_point begin) {
+    wait_time() += std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+  }
+
+
   Exchange() {
     nx = -1;
     ny = -1;
@@ -200,6 +215,7 @@ public:
 
 
   void halo_pack_x(real3d const &arr) {
+    TIMER_START("halo_pack");
     YAKL_SCOPE( haloSendBufW , this->haloSendBufW );
     YAKL_SCOPE( haloSendBufE , this->haloSendBufE );
     YAKL_SCOPE( nx           , this->nx           );
@@ -216,8 +232,10 @@ public:
       if (exchE) haloSendBufE(num_pack+v,j,ii) = arr(v,hs+j,nx+ii);
     });
     num_pack += num_vars;
+    TIMER_STOP("halo_pack");
   }
   void halo_pack_x(real2d const &arr) {
+    TIMER_START("halo_pack");
     YAKL_SCOPE( haloSendBufW , this->haloSendBufW );
     YAKL_SCOPE( haloSendBufE , this->haloSendBufE );
     YAKL_SCOPE( nx           , this->nx           );
@@ -233,10 +251,12 @@ public:
       if (exchE) haloSendBufE(num_pack,j,ii) = arr(hs+j,nx+ii);
     });
     num_pack++;
+    TIMER_STOP("halo_pack");
   }
 
 
   void halo_pack_y(real3d const &arr) {
+    TIMER_START("halo_pack");
     YAKL_SCOPE( haloSendBufS , this->haloSendBufS );
     YAKL_SCOPE( haloSendBufN , this->haloSendBufN );
     YAKL_SCOPE( nx           , this->nx           );
@@ -253,8 +273,10 @@ public:
       if (exchN) haloSendBufN(num_pack+v,jj,i) = arr(v,ny+jj,hs+i);
     });
     num_pack += num_vars;
+    TIMER_STOP("halo_pack");
   }
   void halo_pack_y(real2d const &arr) {
+    TIMER_START("halo_pack");
     YAKL_SCOPE( haloSendBufS , this->haloSendBufS );
     YAKL_SCOPE( haloSendBufN , this->haloSendBufN );
     YAKL_SCOPE( nx           , this->nx           );
@@ -270,10 +292,12 @@ public:
       if (exchN) haloSendBufN(num_pack,jj,i) = arr(ny+jj,hs+i);
     });
     num_pack++;
+    TIMER_STOP("halo_pack");
   }
 
 
   void halo_unpack_x(real3d &arr) {
+    TIMER_START("halo_unpack");
     YAKL_SCOPE( haloRecvBufW , this->haloRecvBufW );
     YAKL_SCOPE( haloRecvBufE , this->haloRecvBufE );
     YAKL_SCOPE( nx           , this->nx           );
@@ -289,8 +313,10 @@ public:
       if (exchE) arr(v,hs+j,nx+hs+ii) = haloRecvBufE(num_unpack+v,j,ii);
     });
     num_unpack += num_vars;
+    TIMER_STOP("halo_unpack");
   }
   void halo_unpack_x(real2d &arr) {
+    TIMER_START("halo_unpack");
     YAKL_SCOPE( haloRecvBufW , this->haloRecvBufW );
     YAKL_SCOPE( haloRecvBufE , this->haloRecvBufE );
     YAKL_SCOPE( nx           , this->nx           );
@@ -305,10 +331,12 @@ public:
       if (exchE) arr(hs+j,nx+hs+ii) = haloRecvBufE(num_unpack,j,ii);
     });
     num_unpack++;
+    TIMER_STOP("halo_unpack");
   }
 
 
   void halo_unpack_y(real3d &arr) {
+    TIMER_START("halo_unpack");
     YAKL_SCOPE( haloRecvBufS , this->haloRecvBufS );
     YAKL_SCOPE( haloRecvBufN , this->haloRecvBufN );
     YAKL_SCOPE( nx           , this->nx           );
@@ -324,8 +352,10 @@ public:
       if (exchN) arr(v,ny+hs+jj,hs+i) = haloRecvBufN(num_unpack+v,jj,i);
     });
     num_unpack += num_vars;
+    TIMER_STOP("halo_unpack");
   }
   void halo_unpack_y(real2d &arr) {
+    TIMER_START("halo_unpack");
     YAKL_SCOPE( haloRecvBufS , this->haloRecvBufS );
     YAKL_SCOPE( haloRecvBufN , this->haloRecvBufN );
     YAKL_SCOPE( nx           , this->nx           );
@@ -340,10 +370,12 @@ public:
       if (exchN) arr(ny+hs+jj,hs+i) = haloRecvBufN(num_unpack,jj,i);
     });
     num_unpack++;
+    TIMER_STOP("halo_unpack");
   }
 
 
   void halo_exchange_x() {
+    TIMER_START("halo_exchange");
     #ifdef __ENABLE_MPI__
       int ierr;
 
@@ -366,6 +398,8 @@ public:
                                      MPI_COMM_WORLD , &sReq[1] ) , __LINE__ );
 
       //Wait for the sends and receives to finish
+      TIMER_START("wait");
+      auto wait_begin = std::chrono::steady_clock::now();
       if (exchW) {
         mpiwrap( MPI_Wait(&sReq[0], &sStat[0]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[0], &rStat[0]) , __LINE__ );
@@ -374,14 +408,18 @@ public:
         mpiwrap( MPI_Wait(&sReq[1], &sStat[1]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[1], &rStat[1]) , __LINE__ );
       }
+      add_wait( wait_begin );
+      TIMER_STOP("wait");
 
       if (exchW) haloRecvBufW_host.deep_copy_to(haloRecvBufW);
       if (exchE) haloRecvBufE_host.deep_copy_to(haloRecvBufE);
     #endif
+    TIMER_STOP("halo_exchange");
   }
 
 
   void halo_exchange_y() {
+    TIMER_START("halo_exchange");
     #ifdef __ENABLE_MPI__
       int ierr;
 
@@ -404,6 +442,8 @@ public:
                                      MPI_COMM_WORLD , &sReq[1] ) , __LINE__ );
 
       //Wait for the sends and receives to finish
+      TIMER_START("wait");
+      auto wait_begin = std::chrono::steady_clock::now();
       if (exchS) {
         mpiwrap( MPI_Wait(&sReq[0], &sStat[0]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[0], &rStat[0]) , __LINE__ );
@@ -412,10 +452,13 @@ public:
         mpiwrap( MPI_Wait(&sReq[1], &sStat[1]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[1], &rStat[1]) , __LINE__ );
       }
+      add_wait( wait_begin );
+      TIMER_STOP("wait");
 
       if (exchS) haloRecvBufS_host.deep_copy_to(haloRecvBufS);
       if (exchN) haloRecvBufN_host.deep_copy_to(haloRecvBufN);
     #endif
+    TIMER_STOP("halo_exchange");
   }
 
 
@@ -429,115 +472,80 @@ public:
   }
 
 
-  void edge_pack_x(real4d const &fwaves, real3d const &surf, real3d const &h_u, real3d const &u_u) {
+  // edges is (variable , side , boundary , transverse cell), where side 0 / 1 are the lower / upper sides of an
+  // interface, and boundary 0 / 1 are this rank's first / last interface along the exchange direction
+  void edge_pack_x(real4d const &edges) {
+    TIMER_START("edge_pack");
     YAKL_SCOPE( edgeSendBufW , this->edgeSendBufW );
     YAKL_SCOPE( edgeSendBufE , this->edgeSendBufE );
-    YAKL_SCOPE( nx           , this->nx           );
     YAKL_SCOPE( ny           , this->ny           );
     YAKL_SCOPE( exchW        , this->exchW        );
     YAKL_SCOPE( exchE        , this->exchE        );
-    int numState = fwaves.dimension[0];
-    parallel_for( SimpleBounds<2>(numState+3,ny) , YAKL_LAMBDA (int v, int j) {
-      if (v < numState) {
-        if (exchW) edgeSendBufW(v,j) = fwaves(v,1,j,0 );
-        if (exchE) edgeSendBufE(v,j) = fwaves(v,0,j,nx);
-      } else if (v == numState) { 
-        if (exchW) edgeSendBufW(v,j) = surf(1,j,0 );
-        if (exchE) edgeSendBufE(v,j) = surf(0,j,nx);
-      } else if (v == numState+1) { 
-        if (exchW) edgeSendBufW(v,j) = h_u(1,j,0 );
-        if (exchE) edgeSendBufE(v,j) = h_u(0,j,nx);
-      } else if (v == numState+2) { 
-        if (exchW) edgeSendBufW(v,j) = u_u(1,j,0 );
-        if (exchE) edgeSendBufE(v,j) = u_u(0,j,nx);
-      }
+    int num_vars = edges.dimension[0];
+    if (num_pack + num_vars > max_pack) endrun("ERROR: Packing too many variables. Increase max_pack");
+    parallel_for( SimpleBounds<2>(num_vars,ny) , YAKL_LAMBDA (int v, int j) {
+      if (exchW) edgeSendBufW(v,j) = edges(v,1,0,j);
+      if (exchE) edgeSendBufE(v,j) = edges(v,0,1,j);
     });
-    num_pack += numState+3;
+    num_pack += num_vars;
+    TIMER_STOP("edge_pack");
   }
 
 
-  void edge_pack_y(real4d const &fwaves, real3d const &surf, real3d const &h_v, real3d const &v_v) {
+  void edge_pack_y(real4d const &edges) {
+    TIMER_START("edge_pack");
     YAKL_SCOPE( edgeSendBufS , this->edgeSendBufS );
     YAKL_SCOPE( edgeSendBufN , this->edgeSendBufN );
     YAKL_SCOPE( nx           , this->nx           );
-    YAKL_SCOPE( ny           , this->ny           );
     YAKL_SCOPE( exchS        , this->exchS        );
     YAKL_SCOPE( exchN        , this->exchN        );
-    int numState = fwaves.dimension[0];
-    parallel_for( SimpleBounds<2>(numState+3,nx) , YAKL_LAMBDA (int v, int i) {
-      if (v < numState) {
-        if (exchS) edgeSendBufS(v,i) = fwaves(v,1,0 ,i);
-        if (exchN) edgeSendBufN(v,i) = fwaves(v,0,ny,i);
-      } else if (v == numState) {
-        if (exchS) edgeSendBufS(v,i) = surf(1,0 ,i);
-        if (exchN) edgeSendBufN(v,i) = surf(0,ny,i);
-      } else if (v == numState+1) { 
-        if (exchS) edgeSendBufS(v,i) = h_v(1,0 ,i);
-        if (exchN) edgeSendBufN(v,i) = h_v(0,ny,i);
-      } else if (v == numState+2) { 
-        if (exchS) edgeSendBufS(v,i) = v_v(1,0 ,i);
-        if (exchN) edgeSendBufN(v,i) = v_v(0,ny,i);
-      }
+    int num_vars = edges.dimension[0];
+    if (num_pack + num_vars > max_pack) endrun("ERROR: Packing too many variables. Increase max_pack");
+    parallel_for( SimpleBounds<2>(num_vars,nx) , YAKL_LAMBDA (int v, int i) {
+      if (exchS) edgeSendBufS(v,i) = edges(v,1,0,i);
+      if (exchN) edgeSendBufN(v,i) = edges(v,0,1,i);
     });
-    num_pack += numState+3;
+    num_pack += num_vars;
+    TIMER_STOP("edge_pack");
   }
 
 
-  void edge_unpack_x(real4d &fwaves, real3d &surf, real3d &h_u, real3d &u_u) {
+  void edge_unpack_x(real4d &edges) {
+    TIMER_START("edge_unpack");
     YAKL_SCOPE( edgeRecvBufW , this->edgeRecvBufW );
     YAKL_SCOPE( edgeRecvBufE , this->edgeRecvBufE );
-    YAKL_SCOPE( nx           , this->nx           );
     YAKL_SCOPE( ny           , this->ny           );
     YAKL_SCOPE( exchW        , this->exchW        );
     YAKL_SCOPE( exchE        , this->exchE        );
-    int numState = fwaves.dimension[0];
-    parallel_for( SimpleBounds<2>(numState+3,ny) , YAKL_LAMBDA (int v, int j) {
-      if (v < numState) {
-        if (exchW) fwaves(v,0,j,0 ) = edgeRecvBufW(v,j);
-        if (exchE) fwaves(v,1,j,nx) = edgeRecvBufE(v,j);
-      } else if (v == numState) {
-        if (exchW) surf(0,j,0 ) = edgeRecvBufW(v,j);
-        if (exchE) surf(1,j,nx) = edgeRecvBufE(v,j);
-      } else if (v == numState+1) {
-        if (exchW) h_u(0,j,0 ) = edgeRecvBufW(v,j);
-        if (exchE) h_u(1,j,nx) = edgeRecvBufE(v,j);
-      } else if (v == numState+2) {
-        if (exchW) u_u(0,j,0 ) = edgeRecvBufW(v,j);
-        if (exchE) u_u(1,j,nx) = edgeRecvBufE(v,j);
-      }
+    int num_vars = edges.dimension[0];
+    parallel_for( SimpleBounds<2>(num_vars,ny) , YAKL_LAMBDA (int v, int j) {
+      if (exchW) edges(v,0,0,j) = edgeRecvBufW(v,j);
+      if (exchE) edges(v,1,1,j) = edgeRecvBufE(v,j);
     });
-    num_unpack += numState+3;
+    num_unpack += num_vars;
+    TIMER_STOP("edge_unpack");
   }
 
 
-  void edge_unpack_y(real4d &fwaves, real3d &surf, real3d &h_v, real3d &v_v) {
+  void edge_unpack_y(real4d &edges) {
+    TIMER_START("edge_unpack");
     YAKL_SCOPE( edgeRecvBufS , this->edgeRecvBufS );
     YAKL_SCOPE( edgeRecvBufN , this->edgeRecvBufN );
     YAKL_SCOPE( nx           , this->nx           );
-    YAKL_SCOPE( ny           , this->ny           );
     YAKL_SCOPE( exchS        , this->exchS        );
     YAKL_SCOPE( exchN        , this->exchN        );
-    int numState = fwaves.dimension[0];
-    parallel_for( SimpleBounds<2>(numState+3,nx) , YAKL_LAMBDA (int v, int i) {
-      if (v < numState) {
-        if (exchS) fwaves(v,0,0 ,i) = edgeRecvBufS(v,i);
-        if (exchN) fwaves(v,1,ny,i) = edgeRecvBufN(v,i);
-      } else if (v == numState) {
-        if (exchS) surf(0,0 ,i) = edgeRecvBufS(v,i);
-        if (exchN) surf(1,ny,i) = edgeRecvBufN(v,i);
-      } else if (v == numState+1) {
-        if (exchS) h_v(0,0 ,i) = edgeRecvBufS(v,i);
-        if (exchN) h_v(1,ny,i) = edgeRecvBufN(v,i);
-      } else if (v == numState+2) {
-        if (exchS) v_v(0,0 ,i) = edgeRecvBufS(v,i);
-        if (exchN) v_v(1,ny,i) = edgeRecvBufN(v,i);
-      }
+    int num_vars = edges.dimension[0];
+    parallel_for( SimpleBounds<2>(num_vars,nx) , YAKL_LAMBDA (int v, int i) {
+      if (exchS) edges(v,0,0,i) = edgeRecvBufS(v,i);
+      if (exchN) edges(v,1,1,i) = edgeRecvBufN(v,i);
     });
-    num_unpack += numState+3;
+    num_unpack += num_vars;
+    TIMER_STOP("edge_unpack");
   }
 
 
   void edge_exchange_x() {
+    TIMER_START("edge_exchange");
     #ifdef __ENABLE_MPI__
       int ierr;
 
@@ -560,6 +568,8 @@ public:
                                      MPI_COMM_WORLD , &sReq[1] ) , __LINE__ );
 
       //Wait for the sends and receives to finish
+      TIMER_START("wait");
+      auto wait_begin = std::chrono::steady_clock::now();
       if (exchW) {
         mpiwrap( MPI_Wait(&sReq[0], &sStat[0]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[0], &rStat[0]) , __LINE__ );
@@ -568,14 +578,18 @@ public:
         mpiwrap( MPI_Wait(&sReq[1], &sStat[1]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[1], &rStat[1]) , __LINE__ );
       }
+      add_wait( wait_begin );
+      TIMER_STOP("wait");
 
       if (exchW) edgeRecvBufW_host.deep_copy_to(edgeRecvBufW);
       if (exchE) edgeRecvBufE_host.deep_copy_to(edgeRecvBufE);
     #endif
+    TIMER_STOP("edge_exchange");
   }
 
 
   void edge_exchange_y() {
+    TIMER_START("edge_exchange");
     #ifdef __ENABLE_MPI__
       int ierr;
 
@@ -598,6 +612,8 @@ public:
                                      MPI_COMM_WORLD , &sReq[1] ) , __LINE__ );
 
       //Wait for the sends and receives to finish
+      TIMER_START("wait");
+      auto wait_begin = std::chrono::steady_clock::now();
       if (exchS) {
         mpiwrap( MPI_Wait(&sReq[0], &sStat[0]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[0], &rStat[0]) , __LINE__ );
@@ -606,10 +622,13 @@ public:
         mpiwrap( MPI_Wait(&sReq[1], &sStat[1]) , __LINE__ );
         mpiwrap( MPI_Wait(&rReq[1], &rStat[1]) , __LINE__ );
       }
+      add_wait( wait_begin );
+      TIMER_STOP("wait");
 
       if (exchS) edgeRecvBufS_host.deep_copy_to(edgeRecvBufS);
       if (exchN) edgeRecvBufN_host.deep_copy_to(edgeRecvBufN);
     #endif
+    TIMER_STOP("edge_exchange");
   }
 
 
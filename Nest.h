@@ -0,0 +1,266 @@
+
+#pragma once
+
+#include "const.h"
+#include "Checkpoint.h"
+
+
+// A static, one-way nested grid: a refined subdomain running its own model inside the coarse grid. The nest's
+// input file describes its grid like any other, with "nest" boundaries, plus its refinement ratio and the first
+// coarse cell it covers. Each coarse time step, the nest subcycles at its own time step, and its boundary halos
+// take the coarse surface height, velocities, and tracer concentrations interpolated linearly in time across
+// the coarse step. Nothing is fed back to the coarse grid.
+template <class Spatial>
+class Nest {
+public:
+
+  typedef Temporal_operator<Spatial> Model;
+
+  int static constexpr hs   = Spatial::hs;
+  int static constexpr idH  = Spatial::idH;
+  int static constexpr idU  = Spatial::idU;
+  int static constexpr idV  = Spatial::idV;
+  int static constexpr idTr = Spatial::idTr;
+
+  Model  model;
+  real3d state;
+  real   cfl;
+
+  int ratio;    // Refinement ratio
+  int ci_beg;   // First coarse cell covered by the nest in x
+  int cj_beg;   // First coarse cell covered by the nest in y
+  int ring_x;   // Coarse cells beyond the nest needed to fill its halos in x
+  int ring_y;   // Coarse cells beyond the nest needed to fill its halos in y
+  int cnx;      // Coarse cells covered by the nest in x
+  int cny;      // Coarse cells covered by the nest in y
+  // Coarse surface height, velocities, and tracer concentrations in the ring around the nest that its halos
+  // are filled from, at the beginning and end of the coarse time step: (surface / u / v / tracers , ring cell).
+  // The ring's cells are numbered by ring_cell(), and the corners, which no halo reads, are left out.
+  real2d coarse_old;
+  real2d coarse_new;
+
+
+  // Initialize the nest from its input file, or from restart_file's checkpoint when one is given. The coarse
+  // data at the end of the last coarse step is gathered again from the coarse state.
+  void init(std::string inFile, Spatial const &coarse, real3d const &coarse_state, std::string restart_file = "",
+            bool collective = false) {
+    YAML::Node config = YAML::LoadFile(inFile);
+    if ( !config                ) { endrun("ERROR: Invalid nest YAML input file"); }
+    if ( !config["nest_ratio"] ) { endrun("ERROR: no nest_ratio entry"); }
+    if ( !config["nest_i_beg"] ) { endrun("ERROR: no nest_i_beg entry"); }
+    ratio  = config["nest_ratio"].as<int>();
+    ci_beg = config["nest_i_beg"].as<int>();
+    cj_beg = 0;
+    if (config["nest_j_beg"]) { cj_beg = config["nest_j_beg"].as<int>(); }
+    cfl    = config["cfl"       ].as<real>();
+
+    model.init(inFile);
+    Spatial &fine = model.space_op;
+
+    if (fine.bc_x != Spatial::BC_NEST) { endrun("ERROR: A nested grid needs bc_x: nest"); }
+    if (fine.nx_glob % ratio != 0) { endrun("ERROR: The nest's nx_glob must be a multiple of nest_ratio"); }
+    if (abs(fine.dx*ratio - coarse.dx) > 1.e-6_fp*coarse.dx) { endrun("ERROR: The nest's xlen doesn't match its coarse cells"); }
+    cnx     = fine.nx_glob / ratio;
+    cny     = 1;
+    ring_x  = (hs + ratio - 1) / ratio;
+    ring_y  = 0;
+    if (! fine.sim1d) {
+      if (fine.bc_y != Spatial::BC_NEST) { endrun("ERROR: A nested grid needs bc_y: nest"); }
+      if (fine.ny_glob % ratio != 0) { endrun("ERROR: The nest's ny_glob must be a multiple of nest_ratio"); }
+      if (abs(fine.dy*ratio - coarse.dy) > 1.e-6_fp*coarse.dy) { endrun("ERROR: The nest's ylen doesn't match its coarse cells"); }
+      cny    = fine.ny_glob / ratio;
+      ring_y = ring_x;
+    }
+    if (ci_beg-ring_x < 0 || ci_beg+cnx+ring_x > coarse.nx_glob ||
+        cj_beg-ring_y < 0 || cj_beg+cny+ring_y > coarse.ny_glob) {
+      endrun("ERROR: The nest and its halos must lie within the coarse grid's interior");
+    }
+
+    // The nest takes its bathymetry and initial state from the same data profiles as the coarse grid
+    fine.x_offset  = ci_beg * coarse.dx;
+    fine.y_offset  = cj_beg * coarse.dy;
+    fine.data_xlen = coarse.data_xlen;
+    fine.data_ylen = coarse.data_ylen;
+
+    state = model.create_state_arr();
+    if (! restart_file.empty()) {
+      Checkpoint<Spatial>::read( model , state , restart_file , collective );
+    } else {
+      model.init_state(state);
+    }
+
+    int nring = 2*ring_y*cnx + 2*ring_x*cny;
+    coarse_old = real2d("coarse_old",3+num_tracers,nring);
+    coarse_new = real2d("coarse_new",3+num_tracers,nring);
+    gather_coarse( coarse , coarse_state , coarse_new );
+  }
+
+
+  // Cell (jc,ic) of the coarse box covering the nest and its ring, counted from the ring's lower-left corner, of
+  // ring cell r. The strips below and above the nest come first, then those to its left and right.
+  YAKL_INLINE static void ring_cell(int r, int cnx, int cny, int ring_x, int ring_y, int &jc, int &ic) {
+    int nband_y = ring_y*cnx;
+    if (r < 2*nband_y) {
+      int side = r / nband_y;
+      int k    = r % nband_y;
+      jc = (side == 0 ? 0 : ring_y+cny) + k / cnx;
+      ic = ring_x + k % cnx;
+    } else {
+      int nband_x = ring_x*cny;
+      int side    = (r - 2*nband_y) / nband_x;
+      int k       = (r - 2*nband_y) % nband_x;
+      jc = ring_y + k / ring_x;
+      ic = (side == 0 ? 0 : ring_x+cnx) + k % ring_x;
+    }
+  }
+
+
+  // Ring cell of coarse cell (jc,ic) outside the nest and its corners, the inverse of ring_cell()
+  YAKL_INLINE static int ring_index(int jc, int ic, int cnx, int cny, int ring_x, int ring_y) {
+    if (jc <  ring_y    ) { return jc*cnx + ic-ring_x; }
+    if (jc >= ring_y+cny) { return ring_y*cnx + (jc-ring_y-cny)*cnx + ic-ring_x; }
+    if (ic <  ring_x    ) { return 2*ring_y*cnx + (jc-ring_y)*ring_x + ic; }
+    return 2*ring_y*cnx + ring_x*cny + (jc-ring_y)*ring_x + ic-ring_x-cnx;
+  }
+
+
+  // Copy the coarse surface height, velocities, and tracer concentrations in the ring around the nest to every
+  // rank, which costs in proportion to the nest's perimeter rather than its area
+  void gather_coarse(Spatial const &coarse, real3d const &coarse_state, real2d &data) {
+    YAKL_SCOPE( bath   , coarse.bath  );
+    YAKL_SCOPE( cnx    , this->cnx    );
+    YAKL_SCOPE( cny    , this->cny    );
+    YAKL_SCOPE( ring_x , this->ring_x );
+    YAKL_SCOPE( ring_y , this->ring_y );
+    int  nring = data.dimension[1];
+    long j_off = cj_beg - ring_y - (long) coarse.j_beg;
+    long i_off = ci_beg - ring_x - (long) coarse.i_beg;
+    int  ny    = coarse.ny;
+    int  nx    = coarse.nx;
+    parallel_for( nring , YAKL_LAMBDA (int r) {
+      int jc, ic;
+      ring_cell( r , cnx , cny , ring_x , ring_y , jc , ic );
+      long j = j_off + jc;
+      long i = i_off + ic;
+      if (j >= 0 && j < ny && i >= 0 && i < nx) {
+        data(0,r) = coarse_state(idH,hs+j,hs+i) + bath(hs+j,hs+i);
+        data(1,r) = coarse_state(idU,hs+j,hs+i);
+        data(2,r) = coarse_state(idV,hs+j,hs+i);
+        real h = coarse_state(idH,hs+j,hs+i);
+        for (int tr=0; tr < num_tracers; tr++) {
+          data(3+tr,r) = h > Spatial::eps ? coarse_state(idTr+tr,hs+j,hs+i) / h : 0;
+        }
+      } else {
+        for (int l=0; l < 3+num_tracers; l++) { data(l,r) = 0; }
+      }
+    });
+    #ifdef __ENABLE_MPI__
+      if (coarse.use_mpi) {
+        // Each coarse cell is owned by exactly one rank, so a sum gathers them
+        auto data_host = data.createHostCopy();
+        TIMER_START("allreduce");
+        auto wait_begin = std::chrono::steady_clock::now();
+        MPI_Allreduce( MPI_IN_PLACE , data_host.data() , data_host.totElems() , coarse.mpi_dtype ,
+                       MPI_SUM , MPI_COMM_WORLD );
+        Exchange::add_wait( wait_begin );
+        TIMER_STOP("allreduce");
+        data_host.deep_copy_to(data);
+      }
+    #endif
+  }
+
+
+  // Fill the nest's boundary state from the coarse data at fraction alpha of the way through the coarse step.
+  // The coarse surface height is held constant across each coarse cell, and the nest's own bathymetry gives
+  // the thickness, so a lake at rest stays at rest across the nest's boundaries. Only the halo cells the sweeps
+  // read are filled: those beyond the nest's edges on the ranks that hold them, without the corners.
+  void set_boundary(real alpha) {
+    Spatial &fine = model.space_op;
+    YAKL_SCOPE( nest_state , fine.nest_state );
+    YAKL_SCOPE( bath       , fine.bath       );
+    YAKL_SCOPE( coarse_old , this->coarse_old );
+    YAKL_SCOPE( coarse_new , this->coarse_new );
+    YAKL_SCOPE( ratio      , this->ratio      );
+    YAKL_SCOPE( cnx        , this->cnx        );
+    YAKL_SCOPE( cny        , this->cny        );
+    YAKL_SCOPE( ring_x     , this->ring_x     );
+    YAKL_SCOPE( ring_y     , this->ring_y     );
+    int  nx    = fine.nx;
+    int  ny    = fine.ny;
+    long j_off = (long) fine.j_beg - hs + ring_y*ratio;
+    long i_off = (long) fine.i_beg - hs + ring_x*ratio;
+
+    // Sides 0 and 1 are the nest's left and right edges, and sides 2 and 3 its bottom and top ones
+    bool lo_x = fine.i_beg == 0;
+    bool hi_x = (long) fine.i_beg + nx == fine.nx_glob;
+    bool lo_y = ! fine.sim1d && fine.j_beg == 0;
+    bool hi_y = ! fine.sim1d && (long) fine.j_beg + ny == fine.ny_glob;
+    parallel_for( SimpleBounds<3>(4,max(nx,ny),hs) , YAKL_LAMBDA (int side, int m, int k) {
+      int j, i;
+      if      (side == 0) { if (! lo_x || m >= ny) return;  j = hs+m;     i = k;       }
+      else if (side == 1) { if (! hi_x || m >= ny) return;  j = hs+m;     i = hs+nx+k; }
+      else if (side == 2) { if (! lo_y || m >= nx) return;  j = k;        i = hs+m;    }
+      else                { if (! hi_y || m >= nx) return;  j = hs+ny+k;  i = hs+m;    }
+      int  jc   = (int) ((j_off + j) / ratio);
+      int  ic   = (int) ((i_off + i) / ratio);
+      int  r    = ring_index( jc , ic , cnx , cny , ring_x , ring_y );
+      real surf = (1-alpha)*coarse_old(0,r) + alpha*coarse_new(0,r);
+      real h    = max( surf - bath(j,i) , 0._fp );
+      nest_state(idH,j,i) = h;
+      nest_state(idU,j,i) = (1-alpha)*coarse_old(1,r) + alpha*coarse_new(1,r);
+      nest_state(idV,j,i) = (1-alpha)*coarse_old(2,r) + alpha*coarse_new(2,r);
+      for (int tr=0; tr < num_tracers; tr++) {
+        nest_state(idTr+tr,j,i) = h * ( (1-alpha)*coarse_old(3+tr,r) + alpha*coarse_new(3+tr,r) );
+      }
+    });
+  }
+
+
+  // Advance the nest across a coarse time step of dt that has just been taken by the coarse grid
+  void time_step(Spatial const &coarse, real3d const &coarse_state, real dt) {
+    TIMER_START("nest");
+    std::swap( coarse_old , coarse_new );
+    gather_coarse( coarse , coarse_state , coarse_new );
+
+    int  nsub = (int) ceil( dt / model.compute_time_step(cfl,state) );
+    real dt_f = dt / nsub;
+    for (int sub=0; sub < nsub; sub++) {
+      set_boundary( (sub+0.5_fp) / nsub );
+      model.time_step( state , dt_f );
+    }
+    TIMER_STOP("nest");
+  }
+
+
+  void output(real etime) {
+    model.output( state , etime );
+  }
+
+
+  void output_streams(real_acc etime) {
+    model.space_op.output_streams( state , etime );
+  }
+
+
+  void sample_gauges(real_acc etime) {
+    model.space_op.sample_gauges( state , etime );
+  }
+
+
+  void log_diagnostics(real_acc etime) {
+    model.space_op.log_diagnostics( etime );
+  }
+
+
+  void checkpoint(std::string file, bool collective, typename Checkpoint<Spatial>::Counters counters) {
+    model.space_op.flush_logs();
+    Checkpoint<Spatial>::write( model , state , file , collective , counters );
+  }
+
+
+  void finalize() {
+    if (model.space_op.masterproc) std::cout << "Nested grid:\n";
+    model.finalize( state );
+  }
+
+};
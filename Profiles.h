@@ -118,6 +118,16 @@ namespace profiles {
     h = 1-b;
   }
 
+
+  // Initial concentration of passive tracer tr out of ntr: cosine blobs spread evenly along x
+  YAKL_INLINE real tracer_blob(real x, real y, real xlen, real ylen, int tr, int ntr) {
+    real xn = (x - xlen*(tr+1)/(ntr+1)) / (0.1_fp*xlen);
+    real yn = (y - ylen/2            ) / (0.1_fp*ylen);
+    real dist = sqrt( xn*xn + yn*yn );
+    if (dist <= 1) { return (1 + cos(M_PI*dist)) / 2; }
+    return 0;
+  }
+
 }
 
 
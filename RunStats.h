@@ -0,0 +1,156 @@
+
+#pragma once
+
+#include "const.h"
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#ifdef __ENABLE_MPI__
+  #include "Exchange.h"
+#endif
+
+
+// Throughput of a run as the driver sees it. Each time step is timed from the end of the previous step's output
+// through the time step computation and the step itself, and the output, gauges, logs, and checkpoints between
+// steps are timed as output. With MPI, each rank's busy time is its step time less the time it spent waiting
+// on other ranks, and the imbalance is the slowest rank's busy time over the mean. A progress line with the
+// estimated time left is printed every progress_interval seconds of wall time, and the summary printed at the
+// end of the run also goes to summary_file as JSON for job monitoring.
+class RunStats {
+public:
+
+  typedef std::chrono::steady_clock Clock;
+
+  std::vector<double> step_times;         // Seconds of each step of this run
+  double              output_time;        // Seconds
+  long                cells;              // Global cells of the grid
+  long                updates_per_step;   // Cells times stages times splits
+  double              progress_interval;  // Wall seconds between progress lines, or 0 for none
+  std::string         summary_file;       // Empty for none
+  real_acc            etime_begin;
+  real_acc            sim_time;
+  double              wait_begin;         // Exchange::wait_time() at the start of the run
+  Clock::time_point   run_begin;
+  Clock::time_point   last_progress;
+  Clock::time_point   mark;               // End of the last timed interval
+  bool                masterproc;
+
+
+  // Start timing the run from etime to sim_time
+  void init(YAML::Node const &config, long cells, long updates_per_step, real_acc etime, real_acc sim_time) {
+    this->cells            = cells;
+    this->updates_per_step = updates_per_step;
+    this->etime_begin      = etime;
+    this->sim_time         = sim_time;
+    progress_interval = 60;
+    if (config["progress_interval"]) { progress_interval = config["progress_interval"].as<double>(); }
+    if (config["summary_file"     ]) { summary_file      = config["summary_file"     ].as<std::string>(); }
+    masterproc  = true;
+    wait_begin  = 0;
+    output_time = 0;
+    #ifdef __ENABLE_MPI__
+      int myrank;
+      MPI_Comm_rank( MPI_COMM_WORLD , &myrank );
+      masterproc = myrank == 0;
+      wait_begin = Exchange::wait_time();
+    #endif
+    yakl::fence();
+    run_begin     = Clock::now();
+    last_progress = run_begin;
+    mark          = run_begin;
+  }
+
+
+  // Seconds since the end of the last timed interval, which ends this one
+  double lap() {
+    yakl::fence();
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>( now - mark ).count();
+    mark = now;
+    return seconds;
+  }
+
+
+  void end_step  () { step_times.push_back( lap() ); }
+  void end_output() { output_time += lap(); }
+
+
+  // Print a progress line when progress_interval has passed since the last one
+  void progress(real_acc etime, int nstep) {
+    if (! masterproc || progress_interval <= 0) { return; }
+    if (std::chrono::duration<double>( mark - last_progress ).count() < progress_interval) { return; }
+    last_progress = mark;
+    double elapsed = std::chrono::duration<double>( mark - run_begin ).count();
+    double eta     = etime > etime_begin ? elapsed * (sim_time - etime) / (etime - etime_begin) : 0;
+    std::cout << "Progress: etime " << etime << " / " << sim_time << " (" << std::fixed << std::setprecision(1)
+              << 100 * etime / sim_time << "%) , step " << nstep << " , elapsed " << elapsed << " s , ETA "
+              << eta << " s" << std::defaultfloat << std::setprecision(6) << "\n";
+  }
+
+
+  // Print the summary and write it to summary_file. Every rank must call this.
+  void report() {
+    int    nsteps  = step_times.size();
+    double compute = 0;
+    for (double t : step_times) { compute += t; }
+    double total = std::chrono::duration<double>( mark - run_begin ).count();
+    std::vector<double> sorted = step_times;
+    std::sort( sorted.begin() , sorted.end() );
+    // Nearest-rank percentile
+    auto percentile = [&] (double p) { return nsteps > 0 ? sorted[ (size_t) std::ceil( p * nsteps ) - 1 ] : 0.; };
+    double mean       = nsteps > 0 ? compute / nsteps : 0;
+    double throughput = compute > 0 ? (double) updates_per_step * nsteps / compute : 0;
+
+    int    nranks   = 1;
+    double wait     = 0;
+    #ifdef __ENABLE_MPI__
+      MPI_Comm_size( MPI_COMM_WORLD , &nranks );
+      wait = Exchange::wait_time() - wait_begin;
+    #endif
+    double busy     = compute - wait;
+    double busy_sum = busy;
+    double busy_max = busy;
+    double wait_sum = wait;
+    double wait_max = wait;
+    #ifdef __ENABLE_MPI__
+      MPI_Reduce( &busy , &busy_sum , 1 , MPI_DOUBLE , MPI_SUM , 0 , MPI_COMM_WORLD );
+      MPI_Reduce( &busy , &busy_max , 1 , MPI_DOUBLE , MPI_MAX , 0 , MPI_COMM_WORLD );
+      MPI_Reduce( &wait , &wait_sum , 1 , MPI_DOUBLE , MPI_SUM , 0 , MPI_COMM_WORLD );
+      MPI_Reduce( &wait , &wait_max , 1 , MPI_DOUBLE , MPI_MAX , 0 , MPI_COMM_WORLD );
+    #endif
+    double imbalance = busy_sum > 0 ? busy_max / (busy_sum / nranks) : 1;
+    if (! masterproc) { return; }
+
+    std::cout << "Steps: " << nsteps << " , cell updates per second: " << throughput << "\n";
+    std::cout << "Step time (s): mean " << mean << " , p50 " << percentile(0.5) << " , p99 " << percentile(0.99)
+              << " , max " << (nsteps > 0 ? sorted.back() : 0.) << "\n";
+    std::cout << "Time (s): total " << total << " , steps " << compute << " , output " << output_time << "\n";
+    if (nranks > 1) {
+      std::cout << "Load imbalance (slowest rank's busy time over the mean): " << imbalance
+                << " , MPI wait time (s): mean " << wait_sum / nranks << " , max " << wait_max << "\n";
+    }
+
+    if (! summary_file.empty()) {
+      std::ofstream out( summary_file );
+      if (! out) { endrun( "ERROR: Unable to open summary file " + summary_file ); }
+      out << std::setprecision(9);
+      out << "{\n"
+          << "  \"ranks\": "                   << nranks                << ",\n"
+          << "  \"cells\": "                   << cells                 << ",\n"
+          << "  \"cell_updates_per_step\": "   << updates_per_step      << ",\n"
+          << "  \"steps\": "                   << nsteps                << ",\n"
+          << "  \"cell_updates_per_second\": " << throughput            << ",\n"
+          << "  \"step_time\": { \"mean\": "   << mean << ", \"p50\": " << percentile(0.5) << ", \"p99\": "
+                                               << percentile(0.99) << ", \"max\": "
+                                               << (nsteps > 0 ? sorted.back() : 0.) << " },\n"
+          << "  \"total_time\": "              << total                 << ",\n"
+          << "  \"step_total_time\": "         << compute               << ",\n"
+          << "  \"output_time\": "             << output_time           << ",\n"
+          << "  \"wait_time\": { \"mean\": "   << wait_sum / nranks << ", \"max\": " << wait_max << " },\n"
+          << "  \"imbalance\": "               << imbalance             << "\n"
+          << "}\n";
+    }
+  }
+
+};
@@ -5,8 +5,25 @@
 #include "TransformMatrices.h"
 #include "Profiles.h"
 #include "WenoLimiter.h"
+#include "AsyncWriter.h"
+#include "Timers.h"
+#include <memory>
+#include <algorithm>
+#include <fstream>
+#include <limits>
 #ifdef __ENABLE_MPI__
   #include "Exchange.h"
+  #include <pnetcdf.h>
+  #ifdef __ENABLE_NETCDF4_PAR__
+    #include <netcdf.h>
+    #include <netcdf_par.h>
+  #endif
+#else
+  #include <netcdf.h>
+#endif
+// NetCDF-4 output goes through netCDF-C, which MPI runs need built with parallel HDF5
+#if (! defined(__ENABLE_MPI__) || defined(__ENABLE_NETCDF4_PAR__)) && ! defined(__ENABLE_NETCDF4__)
+  #define __ENABLE_NETCDF4__
 #endif
 
 
@@ -17,7 +34,9 @@ class Spatial_operator {
 public:
 
   int static constexpr hs = ord >= 3 ? (ord-1)/2 : 1;
-  int static constexpr num_state = 3;
+  int static constexpr num_state = 3 + num_tracers;
+  // SArrays batched over the tracers need at least one entry
+  int static constexpr num_tracers_arr = num_tracers > 0 ? num_tracers : 1;
 
   real static constexpr eps = 1.e-10;
 
@@ -33,16 +52,124 @@ public:
   typedef real3d TendArr;
 
   // Flux time derivatives
-  real4d fwaves;
   real4d fwaves_x;
   real4d fwaves_y;
-  real3d surf_limits;
   real3d surf_limits_x;
   real3d surf_limits_y;
   real3d h_u_limits;
   real3d u_u_limits;
   real3d h_v_limits;
   real3d v_v_limits;
+  // Edge limits at this rank's first and last interfaces for dimensionally split sweeps:
+  // (edge variable , side of the interface , first / last interface , transverse cell)
+  real4d edges_x;
+  real4d edges_y;
+  // Whether each row tile of a dimensionally split sweep has work to do: (transverse cell , tile)
+  int2d active_x;
+  int2d active_y;
+  // An output file with its own fields, region, stride, stored precision, and frequency. Its fields are staged
+  // on the device and copied to one of the host buffers for writing: (field , y , x)
+  struct OutputStream {
+    std::string              file;
+    std::vector<int>         fields;   // Indices into output_field_names()
+    int                      stride;
+    int                      i0, i1;   // Global cells of the region in x, [i0,i1)
+    int                      j0, j1;   // Global cells of the region in y, [j0,j1)
+    bool                     single;   // Whether the fields are stored as 32-bit floats
+    real_acc                 freq;     // Output frequency in seconds
+    int                      num_out;  // Outputs written after the initial one
+    long                     rec;      // Next time level to write (negative to append after those in the file)
+    int                      nx_out, ny_out;  // Points in the decimated region
+    int                      ix_beg, iy_beg;  // Index of this rank's first point in the decimated region
+    int                      nx_loc, ny_loc;  // Points on this rank
+    int                      ci_beg, cj_beg;  // Local cell of this rank's first point
+    real3d                   dev_r;
+    float3d                  dev_f;
+    std::vector<realHost3d>  host_r;
+    std::vector<floatHost3d> host_f;
+    int                      next;     // Next host buffer to use
+    int                      deflate;  // NetCDF-4 deflate level of bath and the fields (0 for none)
+    bool                     shuffle;  // Whether NetCDF-4 shuffles their bytes before deflating
+    int                      nsb;      // Significant bits NetCDF-4 keeps of the fields (0 to keep them all)
+    // PnetCDF and NetCDF-4 files stay open from the first output to finalize(): the file's ID (negative while
+    // closed) and the IDs of x, y, t, bath, and the fields in that order
+    int                      ncid;
+    std::vector<int>         varids;
+  };
+  // Stream 0 is out_file, written whenever the driver calls output()
+  std::vector<OutputStream> streams;
+  // Point gauges sampled every few steps. A sample holds the ord x ord cells around each gauge, of which each rank
+  // fills the cells it owns, and the master process gathers the other ranks' cells to complete every stencil
+  // without halos. Samples are buffered on the device and interpolated to the gauges when the buffer is written
+  // to the file.
+  struct Gauges {
+    std::string              file;
+    std::vector<std::string> names;
+    std::vector<real>        x, y;
+    int                      every;     // Steps between samples
+    int                      step;      // Steps taken
+    bool                     header;    // Whether the file's header has been written
+    int2d                    cells;     // Global cell holding each gauge: (gauge , x / y)
+    real5d                   stencils;  // (sample , gauge , thickness / u / v / surface , stencil y , stencil x)
+    std::vector<real_acc>    times;     // Time of each buffered sample
+    std::vector<int>         owned;     // Stencil cells this rank owns, flattened as (gauge , stencil y , stencil x)
+    std::vector<int>         rank_owned;   // On the master process, every rank's owned cells in rank order
+    std::vector<int>         rank_counts;  // On the master process, the number of cells each rank owns
+  };
+  Gauges gauges;
+  // Envelope statistics of each cell over the run for hazard maps, accumulated in the last stage of every time
+  // step and written to file by finalize(): the highest surface, the fastest speed, and the first time the cell
+  // was wet with its surface above threshold (negative until then), and with moments, the time means and
+  // variances of the surface and speed
+  struct Envelope {
+    std::string file;       // Disabled when empty
+    real        threshold;
+    bool        moments;
+    real_acc    etime;      // Time of the state accumulated last
+    real2d      surf_max;   // (y , x)
+    real2d      speed_max;
+    real2d      arrival;
+    real_acc3d  stats;      // Means and time-weighted sums of squared deviations: (surface mean / surface M2 /
+                            // speed mean / speed M2 , y , x)
+  };
+  Envelope envelope;
+  // A time step's update of the envelope statistics, which a temporal operator applies to each cell in the
+  // kernel of its last stage once the cell's state is final
+  struct EnvelopeUpdate {
+    bool       active;
+    bool       moments;
+    real       threshold;
+    real       wet_tol;
+    real       etime;   // Time at the end of the step
+    real_acc   dt;
+    real_acc   frac;    // The step's share of the time accumulated so far
+    real2d     bath;
+    real2d     surf_max;
+    real2d     speed_max;
+    real2d     arrival;
+    real_acc3d stats;
+
+    YAKL_INLINE void operator() (StateArr const &state, int j, int i) const {
+      real h     = state(idH,hs+j,hs+i);
+      real u     = state(idU,hs+j,hs+i);
+      real v     = state(idV,hs+j,hs+i);
+      bool wet   = h > wet_tol;
+      real surf  = h + bath(hs+j,hs+i);
+      real speed = wet ? sqrt(u*u+v*v) : 0;
+      surf_max (j,i) = max( surf_max (j,i) , surf  );
+      speed_max(j,i) = max( speed_max(j,i) , speed );
+      if (arrival(j,i) < 0 && wet && surf > threshold) { arrival(j,i) = etime; }
+      if (moments) {
+        // Welford's update weighted by the step's length
+        real_acc d_surf  = surf  - stats(0,j,i);
+        real_acc d_speed = speed - stats(2,j,i);
+        stats(0,j,i) += frac * d_surf;
+        stats(2,j,i) += frac * d_speed;
+        stats(1,j,i) += dt * d_surf  * (surf  - stats(0,j,i));
+        stats(3,j,i) += dt * d_speed * (speed - stats(2,j,i));
+      }
+    }
+  };
   real2d bath;
   real3d bath_gll_x;
   real3d bath_gll_y;
@@ -66,6 +193,34 @@ public:
   int static constexpr idH = 0;  // rho
   int static constexpr idU = 1;  // u
   int static constexpr idV = 2;  // v
+  int static constexpr idTr = 3;  // h*c of the first passive tracer
+
+  // Edge limits carried by a dimensionally split sweep: the state variables, followed by these
+  int static constexpr idSurf   = num_state;    // surface height
+  int static constexpr idHN     = num_state+1;  // h*n
+  int static constexpr idNN     = num_state+2;  // n*n
+  int static constexpr num_edge = num_state+3;
+
+  // Output fields: thickness, u, v, surface, and the tracers, and the bathymetry's index
+  int static constexpr num_out_fields = 4 + num_tracers;
+  int static constexpr out_bath       = -1;
+
+  // Diagnostics reduced together over the domain: sums of the thickness, energy, |surface - surf_level|, |u|,
+  // |v|, and each tracer's h*c, then maxima of |surface - surf_level|, |u|, |v|, the wave speed, and -dt
+  int static constexpr diag_mass     = 0;
+  int static constexpr diag_energy   = 1;
+  int static constexpr diag_surf_sum = 2;
+  int static constexpr diag_u_sum    = 3;
+  int static constexpr diag_v_sum    = 4;
+  int static constexpr diag_tracer   = 5;
+  int static constexpr num_diag_sum  = 5 + num_tracers;
+  int static constexpr diag_surf_max = num_diag_sum;
+  int static constexpr diag_u_max    = num_diag_sum+1;
+  int static constexpr diag_v_max    = num_diag_sum+2;
+  int static constexpr diag_speed    = num_diag_sum+3;
+  int static constexpr diag_neg_dt   = num_diag_sum+4;
+  int static constexpr num_diag      = num_diag_sum+5;
+  typedef SArray<real_acc,1,num_diag> DiagArr;
 
   int static constexpr DATA_SPEC_DAM_2D               = 1;
   int static constexpr DATA_SPEC_LAKE_AT_REST_PERT_1D = 2;
@@ -81,11 +236,49 @@ public:
   int static constexpr BC_WALL     = 0;
   int static constexpr BC_PERIODIC = 1;
   int static constexpr BC_OPEN     = 2;
+  int static constexpr BC_NEST     = 3;
+
+  int static constexpr DIR_X = 0;
+  int static constexpr DIR_Y = 1;
+
+  // Compile-time boundary policies for the dimensionally split sweeps. Cells beyond a physical boundary
+  // either wrap around to the other end of the domain (periodic), are read from halos prescribed by the
+  // coarse grid (nested), or repeat the nearest interior cell, and walls also reflect the normal velocity
+  // to zero there.
+  struct BCWall     { static bool constexpr periodic = false;  static bool constexpr reflect = true ;
+                      static bool constexpr nested   = false; };
+  struct BCOpen     { static bool constexpr periodic = false;  static bool constexpr reflect = false;
+                      static bool constexpr nested   = false; };
+  struct BCPeriodic { static bool constexpr periodic = true ;  static bool constexpr reflect = false;
+                      static bool constexpr nested   = false; };
+  struct BCNest     { static bool constexpr periodic = false;  static bool constexpr reflect = false;
+                      static bool constexpr nested   = true ; };
 
   bool sim1d;
 
   real surf_level;
 
+  // Origin of this grid and size of the domain the initial data profiles are defined on. These only differ
+  // from zero and xlen / ylen for a nested grid
+  real x_offset;
+  real y_offset;
+  real data_xlen;
+  real data_ylen;
+  // Boundary state prescribed by the coarse grid for nested boundaries, read from its halo cells
+  real3d nest_state;
+
+  // Cells with thickness at or below dry_tol are treated as dry land
+  real dry_tol;
+  // Cells within rest_tol of surf_level with |u|,|v| <= rest_tol are at rest (disabled when negative). Sweeps skip
+  // tiles at rest, apart from the mass and tracer fluxes through their ends
+  real rest_tol;
+  // Whether outputs are written on a background thread while the model steps on, and how many can be pending
+  bool async_output;
+  int  output_buffers;
+  std::shared_ptr<AsyncWriter> writer;
+  // Whether output files are chunked and compressed NetCDF-4 rather than classic NetCDF
+  bool out_netcdf4;
+
   real grav;
   real dx;
   real dy;
@@ -110,9 +303,26 @@ public:
   #ifdef __ENABLE_MPI__
     Exchange exch;
     MPI_Datatype mpi_dtype;
+    MPI_Datatype mpi_acc_dtype;
+    // Communicator of the output files' collective writes, duplicated from MPI_COMM_WORLD for the background
+    // writer so its writes never match the model's own collectives
+    MPI_Comm     io_comm;
   #endif
 
-  real mass_init;
+  real_acc mass_init;
+  std::vector<real_acc> tracer_mass_init;
+  // Log of the diagnostics with a row every diag_every steps (disabled when diag_file is empty). A step's row
+  // is written by the next reduction, which also gives the time step: its time while pending, or negative.
+  std::string                    diag_file;
+  int                            diag_every;
+  int                            diag_step;
+  real_acc                       diag_etime;
+  std::shared_ptr<std::ofstream> diag_log;
+  #ifdef __ENABLE_MPI__
+    // All the diagnostics as one element, so MPI reduces them together without splitting them
+    MPI_Datatype diag_dtype;
+    MPI_Op       diag_op;
+  #endif
 
   // Values read from input file
   int nx_glob;
@@ -150,29 +360,174 @@ public:
 
 
 
-  real compute_time_step(real cfl, StateArr const &state) const {
+  // Stable time step of the state for the given CFL number. When a row of the diagnostics' log is pending, the
+  // reduction also gives the diagnostics and completes the row, and otherwise it only gives the time step.
+  real compute_time_step(real cfl, StateArr const &state) {
+    TIMER_START("compute_time_step");
+    real dt;
+    if (diag_etime >= 0) {
+      DiagArr diag = reduce_diagnostics( state , cfl );
+      write_diagnostics( diag );
+      dt = -diag(diag_neg_dt);
+    } else {
+      dt = reduce_time_step( state , cfl );
+    }
+    TIMER_STOP("compute_time_step");
+    return dt;
+  }
+
+
+
+  // Stable time step of a cell for the given CFL number
+  YAKL_INLINE static real_acc cell_time_step(real_acc h, real_acc u, real_acc v, real grav, real dx, real dy,
+                                             real cfl) {
+    real_acc gw = sqrt(grav*h);
+    real_acc dtx = cfl*dx/max( abs(u+gw) + eps , abs(u-gw) + eps );
+    real_acc dty = cfl*dy/max( abs(v+gw) + eps , abs(v-gw) + eps );
+    return min(dtx,dty);
+  }
+
+
+
+  // Reduce only the time step over the domain, in one reduction and, with MPI, one Allreduce
+  real_acc reduce_time_step(StateArr const &state, real cfl) const {
     YAKL_SCOPE( grav , this->grav );
     YAKL_SCOPE( dx   , this->dx   );
     YAKL_SCOPE( dy   , this->dy   );
 
-    real2d dt2d("dt2d",ny,nx);
+    real_acc2d dt2d("dt2d",ny,nx);
     parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
-      real h = state(idH,hs+j,hs+i);
-      real u = state(idU,hs+j,hs+i);
-      real v = state(idV,hs+j,hs+i);
-      real gw = sqrt(grav*h);
-      real dtx = cfl*dx/max( abs(u+gw) + eps , abs(u-gw) + eps );
-      real dty = cfl*dy/max( abs(v+gw) + eps , abs(v-gw) + eps );
-      dt2d(j,i) = min(dtx,dty);
+      dt2d(j,i) = cell_time_step( state(idH,hs+j,hs+i) , state(idU,hs+j,hs+i) , state(idV,hs+j,hs+i) ,
+                                  grav , dx , dy , cfl );
     });
-    real dtloc = yakl::intrinsics::minval(dt2d);
-    real dtglob;
+    real_acc dt = yakl::intrinsics::minval(dt2d);
     #ifdef __ENABLE_MPI__
-      int ierr = MPI_Allreduce(&dtloc, &dtglob, 1, mpi_dtype , MPI_MIN, MPI_COMM_WORLD);
-    #else
-      dtglob = dtloc;
+      if (use_mpi) {
+        real_acc dt_loc = dt;
+        TIMER_START("allreduce");
+        auto wait_begin = std::chrono::steady_clock::now();
+        MPI_Allreduce( &dt_loc , &dt , 1 , mpi_acc_dtype , MPI_MIN , MPI_COMM_WORLD );
+        Exchange::add_wait( wait_begin );
+        TIMER_STOP("allreduce");
+      }
+    #endif
+    return dt;
+  }
+
+
+
+  // Reduce every diagnostic over the domain in one pass over the state and, with MPI, one Allreduce. Each thread
+  // accumulates them over a tile of a row, and every diagnostic's tiles are then combined pairwise in a tree of
+  // kernels that halves their number each time, so there's a single copy back to the host. The time step for the
+  // given CFL number is computed cell by cell as in reduce_time_step.
+  DiagArr reduce_diagnostics(StateArr const &state, real cfl = 1) const {
+    YAKL_SCOPE( bath       , this->bath       );
+    YAKL_SCOPE( grav       , this->grav       );
+    YAKL_SCOPE( dx         , this->dx         );
+    YAKL_SCOPE( dy         , this->dy         );
+    YAKL_SCOPE( nx         , this->nx         );
+    YAKL_SCOPE( ny         , this->ny         );
+    YAKL_SCOPE( surf_level , this->surf_level );
+
+    int ntile = (nx + sweep_tile - 1) / sweep_tile;
+    real_acc2d partial("diag_partial",num_diag,ny*ntile);
+    parallel_for( SimpleBounds<2>(ny,ntile) , YAKL_LAMBDA (int j, int t) {
+      DiagArr d;
+      for (int q=0; q < num_diag; q++) { d(q) = q < num_diag_sum ? 0 : -1.e300; }
+      for (int i=t*sweep_tile; i < min(nx,(t+1)*sweep_tile); i++) {
+        real_acc h = state(idH,hs+j,hs+i);
+        real_acc u = state(idU,hs+j,hs+i);
+        real_acc v = state(idV,hs+j,hs+i);
+        real_acc b = bath(hs+j,hs+i);
+        real_acc gw = sqrt(grav*h);
+        real_acc surf_dev = abs(h+b-surf_level);
+        d(diag_mass    ) += h;
+        d(diag_energy  ) += 0.5*h*(u*u+v*v) + grav*h*(b+0.5*h);
+        d(diag_surf_sum) += surf_dev;
+        d(diag_u_sum   ) += abs(u);
+        d(diag_v_sum   ) += abs(v);
+        for (int tr=0; tr < num_tracers; tr++) { d(diag_tracer+tr) += state(idTr+tr,hs+j,hs+i); }
+        d(diag_surf_max) = max( d(diag_surf_max) , surf_dev );
+        d(diag_u_max   ) = max( d(diag_u_max   ) , abs(u) );
+        d(diag_v_max   ) = max( d(diag_v_max   ) , abs(v) );
+        d(diag_speed   ) = max( d(diag_speed   ) , max(abs(u),abs(v)) + gw );
+        d(diag_neg_dt  ) = max( d(diag_neg_dt  ) , -cell_time_step(h,u,v,grav,dx,dy,cfl) );
+      }
+      for (int q=0; q < num_diag; q++) { partial(q,j*ntile+t) = d(q); }
+    });
+
+    // Fold the upper half of the remaining tiles onto the lower half until one is left
+    for (int n = ny*ntile; n > 1; n = (n+1)/2) {
+      int half = (n+1)/2;
+      parallel_for( SimpleBounds<2>(num_diag,n/2) , YAKL_LAMBDA (int q, int k) {
+        partial(q,k) = q < num_diag_sum ? partial(q,k) + partial(q,k+half) : max( partial(q,k) , partial(q,k+half) );
+      });
+    }
+
+    real_acc1d diag_dev("diag",num_diag);
+    parallel_for( SimpleBounds<1>(num_diag) , YAKL_LAMBDA (int q) { diag_dev(q) = partial(q,0); });
+    auto diag_host = diag_dev.createHostCopy();
+    DiagArr diag;
+    for (int q=0; q < num_diag; q++) { diag(q) = diag_host(q); }
+    #ifdef __ENABLE_MPI__
+      if (use_mpi) {
+        DiagArr diag_loc = diag;
+        TIMER_START("allreduce");
+        auto wait_begin = std::chrono::steady_clock::now();
+        MPI_Allreduce( &diag_loc , &diag , 1 , diag_dtype , diag_op , MPI_COMM_WORLD );
+        Exchange::add_wait( wait_begin );
+        TIMER_STOP("allreduce");
+      }
     #endif
-    return dtglob;
+    return diag;
+  }
+
+
+
+  #ifdef __ENABLE_MPI__
+    // MPI reduction of the diagnostics: sums, then maxima
+    static void diag_reduce(void *in, void *inout, int *len, MPI_Datatype *type) {
+      real_acc const *a = (real_acc const *) in;
+      real_acc       *b = (real_acc       *) inout;
+      for (int k=0; k < *len; k++) {
+        for (int q=0; q < num_diag; q++) {
+          int n = k*num_diag + q;
+          b[n] = q < num_diag_sum ? a[n] + b[n] : std::max( a[n] , b[n] );
+        }
+      }
+    }
+  #endif
+
+
+
+  // Mark the diagnostics of the state after this step for the log when they're due. Call this after every
+  // time step.
+  void log_diagnostics(real_acc etime) {
+    if (diag_file.empty()) { return; }
+    diag_step++;
+    if (diag_step % diag_every == 0) { diag_etime = etime; }
+  }
+
+
+
+  // Write the pending row of the log: the time, the water's mass and energy, the fastest wave speed, and each
+  // tracer's mass
+  void write_diagnostics(DiagArr const &diag) {
+    if (masterproc) {
+      if (! diag_log) {
+        diag_log = std::make_shared<std::ofstream>( diag_file , std::ios::trunc );
+        *diag_log << "t,mass,energy,max_speed";
+        for (int tr=0; tr < num_tracers; tr++) { *diag_log << "," << tracer_name(tr) << "_mass"; }
+        *diag_log << "\n";
+      }
+      if (! *diag_log) { endrun("ERROR: Couldn't write the diagnostics file " + diag_file); }
+      *diag_log << std::setprecision( std::numeric_limits<real_acc>::max_digits10 )
+                << diag_etime << "," << diag(diag_mass)*dx*dy << "," << diag(diag_energy)*dx*dy << ","
+                << diag(diag_speed);
+      for (int tr=0; tr < num_tracers; tr++) { *diag_log << "," << diag(diag_tracer+tr)*dx*dy; }
+      *diag_log << "\n";
+    }
+    diag_etime = -1;
   }
 
 
@@ -185,6 +540,11 @@ public:
     #ifdef __ENABLE_MPI__
       mpi_dtype = MPI_DOUBLE;
       if (std::is_same<real,float>::value) mpi_dtype = MPI_FLOAT;
+      mpi_acc_dtype = MPI_DOUBLE;
+      if (std::is_same<real_acc,float>::value) mpi_acc_dtype = MPI_FLOAT;
+      MPI_Type_contiguous( num_diag , mpi_acc_dtype , &diag_dtype );
+      MPI_Type_commit( &diag_dtype );
+      MPI_Op_create( diag_reduce , 1 , &diag_op );
     #endif
 
     surf_level = -1;
@@ -206,6 +566,39 @@ public:
 
     dimsplit = config["dimsplit"].as<bool>();
 
+    x_offset  = 0;
+    y_offset  = 0;
+    data_xlen = xlen;
+    data_ylen = ylen;
+
+    dry_tol = 0;
+    if (config["dry_tol"]) { dry_tol = config["dry_tol"].as<real>(); }
+
+    rest_tol = -1;
+    if (config["rest_tol"]) { rest_tol = config["rest_tol"].as<real>(); }
+
+    diag_file  = "";
+    diag_every = 1;
+    diag_step  = 0;
+    if (config["diag_file" ]) { diag_file  = config["diag_file" ].as<std::string>(); }
+    if (config["diag_every"]) { diag_every = config["diag_every"].as<int>(); }
+    if (diag_every < 1) { endrun("ERROR: diag_every must be at least 1"); }
+    diag_etime = diag_file.empty() ? -1 : 0;
+
+    envelope.file      = "";
+    envelope.threshold = 0;
+    envelope.moments   = false;
+    envelope.etime     = 0;
+    if (config["envelope_file"     ]) { envelope.file      = config["envelope_file"     ].as<std::string>(); }
+    if (config["envelope_threshold"]) { envelope.threshold = config["envelope_threshold"].as<real>(); }
+    if (config["envelope_moments"  ]) { envelope.moments   = config["envelope_moments"  ].as<bool>(); }
+
+    async_output   = false;
+    output_buffers = 2;
+    if (config["async_output"  ]) { async_output   = config["async_output"  ].as<bool>(); }
+    if (config["output_buffers"]) { output_buffers = config["output_buffers"].as<int>(); }
+    if (output_buffers < 1) { endrun("ERROR: output_buffers must be at least 1"); }
+
     std::string bc_x_str = config["bc_x"].as<std::string>();
     if        (bc_x_str == "periodic") {
       bc_x = BC_PERIODIC;
@@ -213,6 +606,8 @@ public:
       bc_x = BC_WALL;
     } else if (bc_x_str == "open") {
       bc_x = BC_OPEN;
+    } else if (bc_x_str == "nest") {
+      bc_x = BC_NEST;
     } else {
       endrun("ERROR: Invalid bc_x");
     }
@@ -224,6 +619,8 @@ public:
       bc_y = BC_WALL;
     } else if (bc_y_str == "open") {
       bc_y = BC_OPEN;
+    } else if (bc_y_str == "nest") {
+      bc_y = BC_NEST;
     } else {
       endrun("ERROR: Invalid bc_y");
     }
@@ -363,6 +760,66 @@ public:
     dx = xlen/nx_glob;
     dy = ylen/ny_glob;
 
+    init_transforms();
+
+    if (dimsplit) {
+      edges_x       = real4d("edges_x"      ,num_edge,2,2,ny);
+      edges_y       = real4d("edges_y"      ,num_edge,2,2,nx);
+      active_x      = int2d ("active_x"     ,ny,(nx+sweep_tile-1)/sweep_tile);
+      active_y      = int2d ("active_y"     ,nx,(ny+sweep_tile-1)/sweep_tile);
+    } else {
+      fwaves_x      = real4d("fwaves_x"     ,num_state,2,ny,nx+1);
+      fwaves_y      = real4d("fwaves_y"     ,num_state,2,ny+1,nx);
+      surf_limits_x = real3d("surf_limits_x"          ,2,ny,nx+1);
+      surf_limits_y = real3d("surf_limits_y"          ,2,ny+1,nx);
+      h_u_limits    = real3d("h_u_limits"             ,2,ny+1,nx+1);
+      u_u_limits    = real3d("u_u_limits"             ,2,ny+1,nx+1);
+      h_v_limits    = real3d("h_v_limits"             ,2,ny+1,nx+1);
+      v_v_limits    = real3d("v_v_limits"             ,2,ny+1,nx+1);
+    }
+    // The background writer's collective writes run while the model's halo exchanges and reductions go on, so
+    // MPI has to allow calls from both threads at once, and the files get their own communicator. Otherwise,
+    // MPI runs write synchronously
+    #ifdef __ENABLE_MPI__
+      io_comm = MPI_COMM_WORLD;
+      if (async_output) {
+        int provided;
+        MPI_Query_thread( &provided );
+        if (provided < MPI_THREAD_MULTIPLE) {
+          if (masterproc) { std::cout << "WARNING: async_output is ignored without MPI_THREAD_MULTIPLE\n"; }
+          async_output = false;
+        } else {
+          MPI_Comm_dup( MPI_COMM_WORLD , &io_comm );
+        }
+      }
+    #endif
+    init_streams(config);
+    init_gauges(config);
+    if (async_output) { writer = std::make_shared<AsyncWriter>(output_buffers); }
+    if (num_tracers > 0 && ! dimsplit) { endrun("ERROR: Passive tracers require dimsplit"); }
+    if (bc_x == BC_NEST || bc_y == BC_NEST) {
+      if (! dimsplit) { endrun("ERROR: Nested boundaries require dimsplit"); }
+      nest_state = real3d("nest_state",num_state,ny+2*hs,nx+2*hs);
+    }
+    bath         = real2d("bathymetry" ,ny+2*hs,nx+2*hs);
+    if (dimsplit) {
+      bath_gll_x   = real3d("bath_gll_x" ,ny,nx,ngll);
+      bath_gll_y   = real3d("bath_gll_y" ,ny,nx,ngll);
+    } else {
+      bath_gll     = real4d("bath_gll"   ,ny,nx,ngll,ngll);
+    }
+    if (! envelope.file.empty()) {
+      envelope.surf_max  = real2d("env_surf_max" ,ny,nx);
+      envelope.speed_max = real2d("env_speed_max",ny,nx);
+      envelope.arrival   = real2d("env_arrival"  ,ny,nx);
+      if (envelope.moments) { envelope.stats = real_acc3d("env_stats",4,ny,nx); }
+    }
+  }
+
+
+
+  // Reconstruction, ADER, and quadrature matrices, which only depend on ord and ngll
+  void init_transforms() {
     #if (ORD > 1)
       TransformMatrices::weno_sten_to_coefs(weno_recon);
     #endif
@@ -402,27 +859,6 @@ public:
     #if (ORD > 1)
       weno::wenoSetIdealSigma(this->idl,this->sigma);
     #endif
-
-    if (dimsplit) {
-      fwaves       = real4d("fwaves"     ,num_state,2,ny+1,nx+1);
-      surf_limits  = real3d("surf_limits"          ,2,ny+1,nx+1);
-    } else {
-      fwaves_x      = real4d("fwaves_x"     ,num_state,2,ny,nx+1);
-      fwaves_y      = real4d("fwaves_y"     ,num_state,2,ny+1,nx);
-      surf_limits_x = real3d("surf_limits_x"          ,2,ny,nx+1);
-      surf_limits_y = real3d("surf_limits_y"          ,2,ny+1,nx);
-    }
-    h_u_limits   = real3d("h_u_limits"           ,2,ny+1,nx+1);
-    u_u_limits   = real3d("u_u_limits"           ,2,ny+1,nx+1);
-    h_v_limits   = real3d("h_v_limits"           ,2,ny+1,nx+1);
-    v_v_limits   = real3d("v_v_limits"           ,2,ny+1,nx+1);
-    bath         = real2d("bathymetry" ,ny+2*hs,nx+2*hs);
-    if (dimsplit) {
-      bath_gll_x   = real3d("bath_gll_x" ,ny,nx,ngll);
-      bath_gll_y   = real3d("bath_gll_y" ,ny,nx,ngll);
-    } else {
-      bath_gll     = real4d("bath_gll"   ,ny,nx,ngll,ngll);
-    }
   }
 
 
@@ -439,8 +875,10 @@ public:
     YAKL_SCOPE( gllWts_ord  , this->gllWts_ord  );
     YAKL_SCOPE( dx          , this->dx          );
     YAKL_SCOPE( dy          , this->dy          );
-    YAKL_SCOPE( xlen        , this->xlen        );
-    YAKL_SCOPE( ylen        , this->ylen        );
+    YAKL_SCOPE( data_xlen   , this->data_xlen   );
+    YAKL_SCOPE( data_ylen   , this->data_ylen   );
+    YAKL_SCOPE( x_offset    , this->x_offset    );
+    YAKL_SCOPE( y_offset    , this->y_offset    );
     YAKL_SCOPE( i_beg       , this->i_beg       );
     YAKL_SCOPE( j_beg       , this->j_beg       );
     YAKL_SCOPE( sim1d       , this->sim1d       );
@@ -458,48 +896,56 @@ public:
       surf_level = 10;
     } else if (data_spec == DATA_SPEC_BALANCE_NONSMOOTH_1D) {
       surf_level = 10;
+    } else if (data_spec == DATA_SPEC_LAKE_AT_REST_PERT_1D || data_spec == DATA_SPEC_LAKE_AT_REST_PERT_2D) {
+      // Level of the lake away from the perturbation
+      surf_level = 1;
     }
 
     parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
       state(idH,hs+j,hs+i) = 0;
       state(idU,hs+j,hs+i) = 0;
       state(idV,hs+j,hs+i) = 0;
+      for (int tr=0; tr < num_tracers; tr++) { state(idTr+tr,hs+j,hs+i) = 0; }
       bath (    hs+j,hs+i) = 0;
       int i_glob = i_beg + i;
       int j_glob = j_beg + j;
       for (int jj=0; jj < ord; jj++) {
         for (int ii=0; ii < ord; ii++) {
-          real xloc = (i_glob+0.5_fp)*dx + gllPts_ord(ii)*dx;
-          real yloc = (j_glob+0.5_fp)*dy + gllPts_ord(jj)*dy;
-          if (sim1d) yloc = ylen/2.;
+          real xloc = x_offset + (i_glob+0.5_fp)*dx + gllPts_ord(ii)*dx;
+          real yloc = y_offset + (j_glob+0.5_fp)*dy + gllPts_ord(jj)*dy;
+          if (sim1d) yloc = data_ylen/2.;
           real h, u, v, b;
           if        (data_spec == DATA_SPEC_DAM_2D) {
-            profiles::dam_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::dam_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_LAKE_AT_REST_PERT_1D) {
-            profiles::lake_at_rest_pert_1d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::lake_at_rest_pert_1d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_DAM_RECT_1D) {
-            profiles::dam_rect_1d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::dam_rect_1d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_ORDER_1D) {
-            profiles::order_1d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::order_1d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_BALANCE_SMOOTH_1D) {
-            profiles::balance_smooth_1d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::balance_smooth_1d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_BALANCE_NONSMOOTH_1D) {
-            profiles::balance_nonsmooth_1d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::balance_nonsmooth_1d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_LAKE_AT_REST_PERT_2D) {
-            profiles::lake_at_rest_pert_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::lake_at_rest_pert_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_ORDER_2D) {
-            profiles::order_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::order_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_BALANCE_SMOOTH_2D) {
-            profiles::balance_smooth_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::balance_smooth_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_BALANCE_SMOOTH_2D) {
-            profiles::balance_smooth_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::balance_smooth_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           } else if (data_spec == DATA_SPEC_BALANCE_NONSMOOTH_2D) {
-            profiles::balance_nonsmooth_2d(xloc,yloc,xlen,ylen,h,u,v,b);
+            profiles::balance_nonsmooth_2d(xloc,yloc,data_xlen,data_ylen,h,u,v,b);
           }
           state(idH,hs+j,hs+i) += h * gllWts_ord(ii) * gllWts_ord(jj);
           state(idU,hs+j,hs+i) += u * gllWts_ord(ii) * gllWts_ord(jj);
           state(idV,hs+j,hs+i) += v * gllWts_ord(ii) * gllWts_ord(jj);
           bath (    hs+j,hs+i) += b * gllWts_ord(ii) * gllWts_ord(jj);
+          for (int tr=0; tr < num_tracers; tr++) {
+            real c = profiles::tracer_blob(xloc,yloc,data_xlen,data_ylen,tr,num_tracers);
+            state(idTr+tr,hs+j,hs+i) += h * c * gllWts_ord(ii) * gllWts_ord(jj);
+          }
         }
       }
     });
@@ -515,7 +961,7 @@ public:
         exch.halo_exchange_x();
         exch.halo_unpack_x(bath);
         exch.halo_finalize();
-        if (bc_x == BC_WALL || bc_x == BC_OPEN) {
+        if (bc_x == BC_WALL || bc_x == BC_OPEN || bc_x == BC_NEST) {
           if (px == 0) {
             parallel_for( SimpleBounds<2>(ny+2*hs,hs) , YAKL_LAMBDA (int j, int ii) {
               bath(j,      ii) = bath(j,hs     );
@@ -536,7 +982,7 @@ public:
         exch.halo_exchange_y();
         exch.halo_unpack_y(bath);
         exch.halo_finalize();
-        if (bc_y == BC_WALL || bc_y == BC_OPEN) {
+        if (bc_y == BC_WALL || bc_y == BC_OPEN || bc_y == BC_NEST) {
           if (py == 0) {
             parallel_for( SimpleBounds<2>(nx+2*hs,hs) , YAKL_LAMBDA (int i, int ii) {
               bath(      ii,i) = bath(hs     ,i);
@@ -554,7 +1000,7 @@ public:
 
       // x-direction boundaries for bathymetry
       parallel_for( SimpleBounds<2>(ny+2*hs,hs) , YAKL_LAMBDA (int j, int ii) {
-        if        (bc_x == BC_WALL || bc_x == BC_OPEN) {
+        if        (bc_x == BC_WALL || bc_x == BC_OPEN || bc_x == BC_NEST) {
           bath(j,      ii) = bath(j,hs     );
           bath(j,nx+hs+ii) = bath(j,hs+nx-1);
         } else if (bc_x == BC_PERIODIC) {
@@ -564,7 +1010,7 @@ public:
       });
       // y-direction boundaries for bathymetry
       parallel_for( SimpleBounds<2>(nx+2*hs,hs) , YAKL_LAMBDA (int i, int ii) {
-        if        (bc_y == BC_WALL || bc_y == BC_OPEN) {
+        if        (bc_y == BC_WALL || bc_y == BC_OPEN || bc_y == BC_NEST) {
           bath(      ii,i) = bath(hs     ,i);
           bath(ny+hs+ii,i) = bath(hs+ny-1,i);
         } else if (bc_y == BC_PERIODIC) {
@@ -592,21 +1038,14 @@ public:
       }
     });
 
-    real2d mass("mass",ny,nx);
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
-      real h = state(idH,hs+j,hs+i);
-      mass(j,i) = h;
-    });
-    real mass_init_perproc = yakl::intrinsics::sum(mass);
-    mass_init = mass_init_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &mass_init_perproc , &mass_init , 1 , mpi_dtype ,
-                       MPI_SUM , MPI_COMM_WORLD );
-      #endif
-    }
+    // Record the initial total mass of water and of each tracer, which finalize() compares against
+    DiagArr diag = reduce_diagnostics( state );
+    mass_init = diag(diag_mass);
+    tracer_mass_init = std::vector<real_acc>(num_tracers);
+    for (int tr=0; tr < num_tracers; tr++) { tracer_mass_init[tr] = diag(diag_tracer+tr); }
   }
 
+
   
 
   YAKL_INLINE real cosine(real const x, real const x0, real const xrad, real const amp, real const pwr) const {
@@ -625,7 +1064,9 @@ public:
     if (dimsplit) {
       compute_tendencies_dimsplit(state,tend,dt,splitIndex);
     } else {
+      TIMER_START("multidim");
       compute_tendencies_multidim(state,tend,dt);
+      TIMER_STOP("multidim");
     }
   }
 
@@ -635,13 +1076,13 @@ public:
   void compute_tendencies_dimsplit( StateArr &state , TendArr &tend , real dt , int splitIndex ) {
     if (dim_switch) {
       if      (splitIndex == 0) {
-        compute_tendencies_dimsplit_X( state , tend , dt );
+        compute_tendencies_sweep<DIR_X>( state , tend , dt );
       }
       else if (splitIndex == 1) {
         if (sim1d) {
           memset( tend , 0._fp );
         } else {
-          compute_tendencies_dimsplit_Y( state , tend , dt );
+          compute_tendencies_sweep<DIR_Y>( state , tend , dt );
         }
       }
     } else {
@@ -649,10 +1090,10 @@ public:
         if (sim1d) {
           memset( tend , 0._fp );
         } else {
-          compute_tendencies_dimsplit_Y( state , tend , dt );
+          compute_tendencies_sweep<DIR_Y>( state , tend , dt );
         }
       } else if (splitIndex == 1) {
-        compute_tendencies_dimsplit_X( state , tend , dt );
+        compute_tendencies_sweep<DIR_X>( state , tend , dt );
       }
     }
   }
@@ -666,10 +1107,6 @@ public:
 
 
   void compute_tendencies_multidim( StateArr &state , TendArr &tend , real dt ) {
-    YAKL_SCOPE( bc_x          , this->bc_x               );
-    YAKL_SCOPE( bc_y          , this->bc_y               );
-    YAKL_SCOPE( nx            , this->nx                 );
-    YAKL_SCOPE( ny            , this->ny                 );
     YAKL_SCOPE( dx            , this->dx                 );
     YAKL_SCOPE( dy            , this->dy                 );
     YAKL_SCOPE( bath          , this->bath               );
@@ -696,45 +1133,23 @@ public:
     if (sim1d) { endrun("ERROR: Cannot use multidim with ny == 1"); }
 
     // Boundaries
+    TIMER_START("boundaries");
     if (use_mpi) {
 
       #ifdef __ENABLE_MPI__
       #endif
 
     } else {
-
-      parallel_for( SimpleBounds<3>(num_state,ny,hs) , YAKL_LAMBDA (int l, int j, int ii) {
-        if        (bc_x == BC_WALL || bc_x == BC_OPEN) {
-          state(l,hs+j,      ii) = state(l,hs+j,hs     );
-          state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+nx-1);
-          if (bc_x == BC_WALL && l == idU) {
-            state(l,hs+j,      ii) = 0;
-            state(l,hs+j,nx+hs+ii) = 0;
-          }
-        } else if (bc_x == BC_PERIODIC) {
-          state(l,hs+j,      ii) = state(l,hs+j,nx+ii);
-          state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+ii);
-        }
-      });
-
-      parallel_for( SimpleBounds<3>(num_state,hs,nx+2*hs) , YAKL_LAMBDA (int l, int jj, int i) {
-        if        (bc_y == BC_WALL || bc_y == BC_OPEN) {
-          state(l,      jj,i) = state(l,hs     ,i);
-          state(l,ny+hs+jj,i) = state(l,hs+ny-1,i);
-          if (bc_y == BC_WALL && l == idV) {
-            state(l,      jj,i) = 0;
-            state(l,ny+hs+jj,i) = 0;
-          }
-        } else if (bc_y == BC_PERIODIC) {
-          state(l,      jj,i) = state(l,ny+jj,i);
-          state(l,ny+hs+jj,i) = state(l,hs+jj,i);
-        }
-      });
-
+      apply_boundaries( state );
     }
+    TIMER_STOP("boundaries");
 
     #if (ORD == 1)
+      YAKL_SCOPE( nx , this->nx );
+      YAKL_SCOPE( ny , this->ny );
+
       // Split the flux difference into characteristic waves
+      TIMER_START("riemann");
       parallel_for( SimpleBounds<2>(ny+1,nx+1) , YAKL_LAMBDA (int j, int i) {
         if (j < ny) {
           // State values for left and right
@@ -855,9 +1270,10 @@ public:
           }
         }
       });
-
+      TIMER_STOP("riemann");
 
       // Apply the tendencies
+      TIMER_START("tendencies");
       parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
         if (l == idH || l == idU) {
           tend(l,j,i) = -( fwaves_x(l,0,j,i+1) - fwaves_x(l,0,j,i) ) / dx;
@@ -870,6 +1286,7 @@ public:
           tend(l,j,i) += -( fwaves_y(l,1,j,i) + fwaves_y(l,0,j+1,i) ) / dy;
         }
       });
+      TIMER_STOP("tendencies");
       return;
     #endif
 
@@ -1038,1185 +1455,1719 @@ public:
 
 
 
-  // Compute state and tendency time derivatives from the state
-  void compute_tendencies_dimsplit_X( StateArr &state , TendArr &tend , real dt ) {
-    YAKL_SCOPE( bc_x         , this->bc_x               );
-    YAKL_SCOPE( nx           , this->nx                 );
-    YAKL_SCOPE( dx           , this->dx                 );
+  // Fill the halos of a single rank's state from its boundary conditions
+  void apply_boundaries( StateArr &state ) const {
+    YAKL_SCOPE( bc_x , this->bc_x );
+    YAKL_SCOPE( bc_y , this->bc_y );
+    YAKL_SCOPE( nx   , this->nx   );
+    YAKL_SCOPE( ny   , this->ny   );
+    parallel_for( SimpleBounds<3>(num_state,ny,hs) , YAKL_LAMBDA (int l, int j, int ii) {
+      if        (bc_x == BC_WALL || bc_x == BC_OPEN) {
+        state(l,hs+j,      ii) = state(l,hs+j,hs     );
+        state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+nx-1);
+        if (bc_x == BC_WALL && l == idU) {
+          state(l,hs+j,      ii) = 0;
+          state(l,hs+j,nx+hs+ii) = 0;
+        }
+      } else if (bc_x == BC_PERIODIC) {
+        state(l,hs+j,      ii) = state(l,hs+j,nx+ii);
+        state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+ii);
+      }
+    });
+
+    parallel_for( SimpleBounds<3>(num_state,hs,nx+2*hs) , YAKL_LAMBDA (int l, int jj, int i) {
+      if        (bc_y == BC_WALL || bc_y == BC_OPEN) {
+        state(l,      jj,i) = state(l,hs     ,i);
+        state(l,ny+hs+jj,i) = state(l,hs+ny-1,i);
+        if (bc_y == BC_WALL && l == idV) {
+          state(l,      jj,i) = 0;
+          state(l,ny+hs+jj,i) = 0;
+        }
+      } else if (bc_y == BC_PERIODIC) {
+        state(l,      jj,i) = state(l,ny+jj,i);
+        state(l,ny+hs+jj,i) = state(l,hs+jj,i);
+      }
+    });
+  }
+
+
+
+  // Compute state and tendency time derivatives from the state for one dimensionally split sweep.
+  // DIR selects the sweep direction at compile time, and the runtime boundary condition along that
+  // direction is dispatched to its compile-time boundary policy.
+  template <int DIR>
+  void compute_tendencies_sweep( StateArr &state , TendArr &tend , real dt ) {
+    int bc = DIR == DIR_X ? bc_x : bc_y;
+    TIMER_START( DIR == DIR_X ? "sweep_x" : "sweep_y" );
+    if      (bc == BC_WALL    ) { compute_tendencies_sweep<DIR,BCWall    >( state , tend , dt ); }
+    else if (bc == BC_OPEN    ) { compute_tendencies_sweep<DIR,BCOpen    >( state , tend , dt ); }
+    else if (bc == BC_PERIODIC) { compute_tendencies_sweep<DIR,BCPeriodic>( state , tend , dt ); }
+    else if (bc == BC_NEST    ) { compute_tendencies_sweep<DIR,BCNest    >( state , tend , dt ); }
+    TIMER_STOP( DIR == DIR_X ? "sweep_x" : "sweep_y" );
+  }
+
+
+
+  // Within the sweep, "n" denotes the velocity normal to the cell interfaces (u for x, v for y), and
+  // "t" denotes the transverse velocity. Halos are only read where they are filled by the MPI exchange,
+  // or by the coarse grid on nested boundaries. Other physical boundaries are applied inline through the
+  // BC policy in the stencil loads and edge limits.
+  template <int DIR, class BC>
+  void compute_tendencies_sweep( StateArr &state , TendArr &tend , real dt ) {
+    // Offsets to the next cell along the sweep direction
+    int constexpr di = DIR == DIR_X ? 1 : 0;
+    int constexpr dj = DIR == DIR_Y ? 1 : 0;
+    // Normal and transverse velocity indices for this sweep
+    int constexpr idN = DIR == DIR_X ? idU : idV;
+    int constexpr idT = DIR == DIR_X ? idV : idU;
+
     YAKL_SCOPE( bath         , this->bath               );
     YAKL_SCOPE( s2g          , this->sten_to_gll        );
     YAKL_SCOPE( s2d2g        , this->sten_to_deriv_gll  );
     YAKL_SCOPE( c2g          , this->coefs_to_gll       );
     YAKL_SCOPE( c2d2g        , this->coefs_to_deriv_gll );
     YAKL_SCOPE( deriv_matrix , this->deriv_matrix       );
-    YAKL_SCOPE( fwaves       , this->fwaves             );
-    YAKL_SCOPE( surf_limits  , this->surf_limits        );
-    YAKL_SCOPE( h_u_limits   , this->h_u_limits         );
-    YAKL_SCOPE( u_u_limits   , this->u_u_limits         );
     YAKL_SCOPE( grav         , this->grav               );
     YAKL_SCOPE( gllWts_ngll  , this->gllWts_ngll        );
     YAKL_SCOPE( idl          , this->idl                );
     YAKL_SCOPE( sigma        , this->sigma              );
     YAKL_SCOPE( weno_recon   , this->weno_recon         );
     YAKL_SCOPE( sim1d        , this->sim1d              );
-    YAKL_SCOPE( use_mpi      , this->use_mpi            );
-    YAKL_SCOPE( bath_gll_x   , this->bath_gll_x         );
+    YAKL_SCOPE( dry_tol      , this->dry_tol            );
+    YAKL_SCOPE( rest_tol     , this->rest_tol           );
+    YAKL_SCOPE( surf_level   , this->surf_level         );
+    YAKL_SCOPE( edges        , DIR == DIR_X ? this->edges_x    : this->edges_y    );
+    YAKL_SCOPE( active       , DIR == DIR_X ? this->active_x   : this->active_y   );
+    YAKL_SCOPE( bath_gll_n   , DIR == DIR_X ? this->bath_gll_x : this->bath_gll_y );
+    YAKL_SCOPE( nest_state   , this->nest_state         );
+
+    real dn    = DIR == DIR_X ? dx      : dy;       // Grid spacing along the sweep
+    int  n     = DIR == DIR_X ? nx      : ny;       // Number of cells along the sweep
+    int  nt    = DIR == DIR_X ? ny      : nx;       // Number of cells transverse to the sweep
+    int  p     = DIR == DIR_X ? px      : py;       // Process grid ID along the sweep
+    int  nproc = DIR == DIR_X ? nproc_x : nproc_y;  // Number of processes along the sweep
+
+    // Whether this rank's first / last cell along the sweep lies on a physical boundary handled by the BC
+    // policy. Otherwise, the neighboring cells and edge limits come from the MPI exchange
+    bool bnd_lo = ! use_mpi || (p == 0       && ! BC::periodic);
+    bool bnd_hi = ! use_mpi || (p == nproc-1 && ! BC::periodic);
 
-    // x-direction boundaries
     if (use_mpi) {
-
       #ifdef __ENABLE_MPI__
         exch.halo_init();
-        exch.halo_pack_x(state);
-        exch.halo_exchange_x();
-        exch.halo_unpack_x(state);
+        if (DIR == DIR_X) { exch.halo_pack_x(state); exch.halo_exchange_x(); exch.halo_unpack_x(state); }
+        else              { exch.halo_pack_y(state); exch.halo_exchange_y(); exch.halo_unpack_y(state); }
         exch.halo_finalize();
-        if (bc_x == BC_WALL || bc_x == BC_OPEN) {
-          if (px == 0) {
-            parallel_for( SimpleBounds<3>(num_state,ny,hs) , YAKL_LAMBDA (int l, int j, int ii) {
-              state(l,hs+j,      ii) = state(l,hs+j,hs     );
-              if (bc_x == BC_WALL && l == idU) {
-                state(l,hs+j,      ii) = 0;
-              }
-            });
-          }
-          if (px == nproc_x-1) {
-            parallel_for( SimpleBounds<3>(num_state,ny,hs) , YAKL_LAMBDA (int l, int j, int ii) {
-              state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+nx-1);
-              if (bc_x == BC_WALL && l == idU) {
-                state(l,hs+j,nx+hs+ii) = 0;
-              }
-            });
-          }
-        }
       #endif
+    }
 
-    } else {
-
-      parallel_for( SimpleBounds<3>(num_state,ny,hs) , YAKL_LAMBDA (int l, int j, int ii) {
-        if        (bc_x == BC_WALL || bc_x == BC_OPEN) {
-          state(l,hs+j,      ii) = state(l,hs+j,hs     );
-          state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+nx-1);
-          if (bc_x == BC_WALL && l == idU) {
-            state(l,hs+j,      ii) = 0;
-            state(l,hs+j,nx+hs+ii) = 0;
-          }
-        } else if (bc_x == BC_PERIODIC) {
-          state(l,hs+j,      ii) = state(l,hs+j,nx+ii);
-          state(l,hs+j,nx+hs+ii) = state(l,hs+j,hs+ii);
-        }
+    if (BC::nested) {
+      // Nested boundaries read the coarse grid's boundary state from the halo
+      TIMER_START("nest_halos");
+      parallel_for( SimpleBounds<3>(num_state,nt,hs) , YAKL_LAMBDA (int l, int t, int kk) {
+        if (bnd_lo) { state(l,dj*kk     +di*(hs+t),di*kk     +dj*(hs+t)) = nest_state(l,dj*kk     +di*(hs+t),
+                                                                                         di*kk     +dj*(hs+t)); }
+        if (bnd_hi) { state(l,dj*(hs+n+kk)+di*(hs+t),di*(hs+n+kk)+dj*(hs+t)) = nest_state(l,dj*(hs+n+kk)+di*(hs+t),
+                                                                                           di*(hs+n+kk)+dj*(hs+t)); }
       });
-
+      TIMER_STOP("nest_halos");
     }
 
 
     #if (ORD == 1)
-      // Split the flux difference into characteristic waves
-      parallel_for( SimpleBounds<2>(ny,nx+1) , YAKL_LAMBDA (int j, int i) {
-        // State values for left and right
-        real h_L  = state(idH,hs+j,hs+i-1);
-        real u_L  = state(idU,hs+j,hs+i-1);
-        real v_L  = state(idV,hs+j,hs+i-1);
-        real hs_L = bath (    hs+j,hs+i-1) + h_L;  // Surface height
-        real h_R  = state(idH,hs+j,hs+i  );
-        real u_R  = state(idU,hs+j,hs+i  );
-        real v_R  = state(idV,hs+j,hs+i  );
-        real hs_R = bath (    hs+j,hs+i  ) + h_R;  // Surface height
-        // Compute interface linearly averaged values for the state
-        real h = 0.5_fp * (h_L + h_R);
-        real u = 0.5_fp * (u_L + u_R);
-        real v = 0.5_fp * (v_L + v_R);
-        real gw = sqrt(grav*h);
-        if (gw > 0) {
-          // Compute flux difference splitting for v
-          fwaves(idV,0,j,i) = 0;
-          fwaves(idV,1,j,i) = 0;
-          if (! sim1d) {
-            if (u < 0) {
-              fwaves(idV,0,j,i) += u*(v_R - v_L);
-            } else {
-              fwaves(idV,1,j,i) += u*(v_R - v_L);
-            }
-          }
-
-          // Compute left and right flux for h and u
-          real f1_L = h_L*u_L;
-          real f1_R = h_R*u_R;
-          real f2_L = u_L*u_L*0.5_fp + grav*hs_L;
-          real f2_R = u_R*u_R*0.5_fp + grav*hs_R;
-          // Compute left and right flux-based characteristic variables
-          real w1_L = 0.5_fp * f1_L - h*f2_L/(2*gw);
-          real w1_R = 0.5_fp * f1_R - h*f2_R/(2*gw);
-          real w2_L = 0.5_fp * f1_L + h*f2_L/(2*gw);
-          real w2_R = 0.5_fp * f1_R + h*f2_R/(2*gw);
-          // Compute upwind flux-based characteristic variables
-          real w1_U, w2_U;
-          // Wave 1 (u-gw)
-          if (u-gw > 0) {
-            w1_U = w1_L;
-          } else {
-            w1_U = w1_R;
+      // Split the flux difference into characteristic waves at each interface along a row, and
+      // apply the tendencies to the cell between consecutive interfaces as soon as both are known
+      TIMER_START("riemann");
+      parallel_for( nt , YAKL_LAMBDA (int t) {
+        real fw_h_prev   = 0;
+        real fw_n_prev   = 0;
+        real fw_t_R_prev = 0;
+        SArray<real,1,num_tracers_arr> fw_c_prev;
+        for (int tr=0; tr < num_tracers; tr++) { fw_c_prev(tr) = 0; }
+        for (int k=0; k <= n; k++) {
+          int j = dj*k + di*t;
+          int i = di*k + dj*t;
+          // Cells on the left and right of the interface
+          int kL = bc_index<BC>( k-1 , n , bnd_lo , bnd_hi );
+          int kR = bc_index<BC>( k   , n , bnd_lo , bnd_hi );
+          int jL = hs + dj*kL + di*t;
+          int iL = hs + di*kL + dj*t;
+          int jR = hs + dj*kR + di*t;
+          int iR = hs + di*kR + dj*t;
+          // State values for left and right
+          real h_L  = state(idH,jL,iL);
+          real n_L  = BC::reflect && kL != k-1 ? 0 : state(idN,jL,iL);
+          real t_L  = state(idT,jL,iL);
+          real hs_L = bath (    jL,iL) + h_L;  // Surface height
+          real h_R  = state(idH,jR,iR);
+          real n_R  = BC::reflect && kR != k   ? 0 : state(idN,jR,iR);
+          real t_R  = state(idT,jR,iR);
+          real hs_R = bath (    jR,iR) + h_R;  // Surface height
+          real fw_h, fw_n, fw_t_L, fw_t_R;
+          split_flux_difference( h_L , n_L , t_L , hs_L , h_L*n_L , n_L*n_L ,
+                                 h_R , n_R , t_R , hs_R , h_R*n_R , n_R*n_R ,
+                                 grav , sim1d , fw_h , fw_n , fw_t_L , fw_t_R );
+          if (k > 0) {
+            tend(idH,j-dj,i-di) = -( fw_h        - fw_h_prev ) / dn;
+            tend(idN,j-dj,i-di) = -( fw_n        - fw_n_prev ) / dn;
+            tend(idT,j-dj,i-di) = -( fw_t_R_prev + fw_t_L    ) / dn;
           }
-          // Wave 2 (u+gw)
-          if (u+gw > 0) {
-            w2_U = w2_L;
-          } else {
-            w2_U = w2_R;
+          fw_h_prev   = fw_h;
+          fw_n_prev   = fw_n;
+          fw_t_R_prev = fw_t_R;
+          // Tracers are carried by the mass flux at the upwind concentration
+          for (int tr=0; tr < num_tracers; tr++) {
+            real h_U  = fw_h > 0 ? h_L                  : h_R;
+            real hc_U = fw_h > 0 ? state(idTr+tr,jL,iL) : state(idTr+tr,jR,iR);
+            real fw_c = fw_h * ( h_U > eps ? hc_U / h_U : 0 );
+            if (k > 0) { tend(idTr+tr,j-dj,i-di) = -( fw_c - fw_c_prev(tr) ) / dn; }
+            fw_c_prev(tr) = fw_c;
           }
-          fwaves(idH,0,j,i) = w1_U + w2_U;
-          fwaves(idU,0,j,i) = -w1_U*gw/h + w2_U*gw/h;
-        } else {
-          fwaves(idV,0,j,i) = 0;
-          fwaves(idV,1,j,i) = 0;
-          fwaves(idH,0,j,i) = 0;
-          fwaves(idU,0,j,i) = 0;
         }
       });
+      TIMER_STOP("riemann");
+      return;
+    #endif
 
-      // Apply the tendencies
-      parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-        if (l == idH || l == idU) {
-          tend(l,j,i) = -( fwaves(l,0,j,i+1) - fwaves(l,0,j,i) ) / dx;
-        } else {
-          tend(l,j,i) = -( fwaves(l,1,j,i) + fwaves(l,0,j,i+1) ) / dx;
+    if (use_mpi) {
+      // Reconstruct the first and last cell of each row for the edge limits at this rank's boundary interfaces.
+      // These are the only edge limits stored in global memory, since the edge exchange needs them
+      TIMER_START("rank_edges");
+      parallel_for( SimpleBounds<2>(nt,2) , YAKL_LAMBDA (int t, int b) {
+        int k = b*(n-1);
+        SArray<real,1,num_edge> lim_lo;
+        SArray<real,1,num_edge> lim_hi;
+        real tend_t;
+        reconstruct_cell_limits<DIR,BC>( state , bath , bath_gll_n , dj*k+di*t , di*k+dj*t , n , bnd_lo , bnd_hi ,
+                                         dn , dt , grav , sim1d , s2g , s2d2g , c2g , c2d2g , deriv_matrix ,
+                                         gllWts_ngll , idl , sigma , weno_recon , lim_lo , lim_hi , tend_t );
+        for (int v=0; v < num_edge; v++) {
+          if (b == 0) edges(v,1,0,t) = lim_lo(v);
+          if (b == 1) edges(v,0,1,t) = lim_hi(v);
         }
       });
-      return;
-    #endif
+      TIMER_STOP("rank_edges");
 
-    // Loop over cells, reconstruct, compute time derivs, time average,
-    // store state edge fluxes, compute cell-centered tendencies
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
-      SArray<real,1,ord> stencil;
+      #ifdef __ENABLE_MPI__
+        exch.edge_init();
+        if (DIR == DIR_X) { exch.edge_pack_x(edges); exch.edge_exchange_x(); exch.edge_unpack_x(edges); }
+        else              { exch.edge_pack_y(edges); exch.edge_exchange_y(); exch.edge_unpack_y(edges); }
+        exch.edge_finalize();
+      #endif
+    }
 
-      // Reconstruct h and u
-      SArray<real,2,nAder,ngll> h_DTs;
-      SArray<real,2,nAder,ngll> u_DTs;
-      SArray<real,2,nAder,ngll> v_DTs;
-      SArray<real,2,nAder,ngll> dv_DTs;
-      SArray<real,2,nAder,ngll> surf_DTs;
-      {
-        real h  = state(idH,hs+j,hs+i);
-        real gw = sqrt(grav*h);
-
-        // Reconstruct first characteristic variable stored in h
-        for (int ii=0; ii<ord; ii++) { stencil(ii) = 0.5_fp * (state(idH,hs+j,i+ii)+bath(hs+j,i+ii)) -
-                                                     h/(2*gw)*state(idU,hs+j,i+ii); }
-        reconstruct_gll_values( stencil , h_DTs , s2g , c2g , idl , sigma , weno_recon );
-
-        // Reconstruct second characteristic variable stored in u
-        for (int ii=0; ii<ord; ii++) { stencil(ii) = 0.5_fp * (state(idH,hs+j,i+ii)+bath(hs+j,i+ii)) +
-                                                     h/(2*gw)*state(idU,hs+j,i+ii); }
-        reconstruct_gll_values( stencil , u_DTs , s2g , c2g , idl , sigma , weno_recon );
-
-        for (int ii=0; ii < ngll; ii++) {
-          real w1 = h_DTs(0,ii);
-          real w2 = u_DTs(0,ii);
-          surf_DTs(0,ii) =       w1 +      w2;
-          u_DTs   (0,ii) = -gw/h*w1 + gw/h*w2;
+    int ntiles = (n + sweep_tile - 1) / sweep_tile;
+
+    // Only the lake-at-rest data defines surf_level
+    bool check_rest = rest_tol >= 0 && surf_level > 0;
+
+    // A row tile is active when the cells within reach of its tendencies are neither all dry nor all at rest.
+    // The reach is the tile's cells, the reconstruction stencils of their neighbors, and one more cell on either
+    // side. At rest, the tendencies vanish by well-balancedness. Reach that extends past this rank into a
+    // neighbor's domain isn't visible here, so those tiles are always active.
+    TIMER_START("active_tiles");
+    parallel_for( SimpleBounds<2>(nt,ntiles) , YAKL_LAMBDA (int t, int tile) {
+      int k_beg = tile*sweep_tile;
+      int k_end = min( k_beg+sweep_tile , n );
+      bool any_wet  = false;
+      bool all_rest = check_rest;
+      for (int kk=k_beg-hs-1; kk < k_end+hs+1; kk++) {
+        int k = bc_index<BC>( kk , n , bnd_lo , bnd_hi );
+        // Waves entering through a nested boundary show up in its halo
+        int k_lo = BC::nested ? -hs  : 0;
+        int k_hi = BC::nested ? n+hs : n;
+        if (k >= k_lo && k < k_hi) {
+          int j = hs + dj*k + di*t;
+          int i = hs + di*k + dj*t;
+          real h = state(idH,j,i);
+          if (h > dry_tol) { any_wet = true; }
+          if (all_rest) {
+            if ( abs(h+bath(j,i)-surf_level) > rest_tol ||
+                 abs(state(idU,j,i))         > rest_tol ||
+                 abs(state(idV,j,i))         > rest_tol ) { all_rest = false; }
+          }
         }
       }
-
-
-      for (int ii=0; ii<ngll; ii++) { h_DTs(0,ii) = surf_DTs(0,ii) - bath_gll_x(j,i,ii); }
-
-      for (int ii=0; ii<ord; ii++) { stencil(ii) = state(idV,hs+j,i+ii); }
-      reconstruct_gll_values_and_derivs( stencil , v_DTs , dv_DTs, dx , s2g , s2d2g ,
-                                         c2g , c2d2g , idl , sigma , weno_recon );
-
-      if (bc_x == BC_WALL) {
-        if (i == nx-1) u_DTs(0,ngll-1) = 0;
-        if (i == 0   ) u_DTs(0,0     ) = 0;
+      bool at_rank_edge = (! bnd_lo && k_beg-hs-1 < 0) || (! bnd_hi && k_end+hs+1 > n);
+      active(t,tile) = at_rank_edge || (any_wet && ! all_rest);
+    });
+    TIMER_STOP("active_tiles");
+
+    // Each thread takes a tile of sweep_tile cells along a row and runs reconstruction, the Riemann split, and
+    // the tendency update back-to-back. Only the previous cell's upper edge limits and the previous interface's
+    // waves are carried from one cell to the next, so the interior edge limits never leave registers. The cell
+    // on either side of a tile is reconstructed again for the limits at the tile's first and last interfaces.
+    // This fuses reconstruction, the Riemann split, and the tendencies, so they're timed together.
+    TIMER_START("recon_riemann");
+    parallel_for( SimpleBounds<2>(nt,ntiles) , YAKL_LAMBDA (int t, int tile) {
+      int k_beg = tile*sweep_tile;
+      int k_end = min( k_beg+sweep_tile , n );
+      // Inactive tiles have only dry land or water at rest in reach, so their tendencies are zero apart from the
+      // mass and tracer fluxes through the tile's two end interfaces, which an active neighbor applies as well.
+      // Only those two Riemann splits are computed, so skipping a tile conserves mass and tracers exactly.
+      bool tile_active = active(t,tile);
+      if (! tile_active) {
+        for (int k=k_beg; k < k_end; k++) {
+          for (int l=0; l < num_state; l++) { tend(l,dj*k+di*t,di*k+dj*t) = 0; }
+        }
       }
-
-      SArray<real,2,nAder,ngll> h_u_DTs;
-      SArray<real,2,nAder,ngll> u_u_DTs;
-      SArray<real,2,nAder,ngll> u_dv_DTs;
-      for (int ii=0; ii<ngll; ii++) {
-        h_u_DTs (0,ii) = h_DTs(0,ii) * u_DTs (0,ii);
-        u_u_DTs (0,ii) = u_DTs(0,ii) * u_DTs (0,ii);
-        u_dv_DTs(0,ii) = u_DTs(0,ii) * dv_DTs(0,ii);
+      SArray<real,1,num_edge> lim_L;     // Lower side of the current interface
+      SArray<real,1,num_edge> lim_R;     // Upper side of the current interface
+      SArray<real,1,num_edge> lim_next;  // Lower side of the next interface
+      SArray<real,1,num_edge> lim_skip;  // Edge limits that aren't needed
+      real tend_skip;
+      real tend_t      = 0;
+      real tend_t_prev = 0;
+      real fw_h_prev   = 0;
+      real fw_n_prev   = 0;
+      real fw_t_R_prev = 0;
+      SArray<real,1,num_tracers_arr> fw_c_prev;
+      for (int tr=0; tr < num_tracers; tr++) { fw_c_prev(tr) = 0; }
+      if (k_beg > 0) {
+        reconstruct_cell_limits<DIR,BC>( state , bath , bath_gll_n , dj*(k_beg-1)+di*t , di*(k_beg-1)+dj*t , n ,
+                                         bnd_lo , bnd_hi , dn , dt , grav , sim1d , s2g , s2d2g , c2g , c2d2g ,
+                                         deriv_matrix , gllWts_ngll , idl , sigma , weno_recon , lim_skip , lim_L ,
+                                         tend_skip );
       }
-
-      if (nAder > 1) {
-        for (int kt=0; kt < nAder-1; kt++) {
-          // Compute state at kt+1
-          for (int ii=0; ii<ngll; ii++) {
-            // Compute d_dx(h*u) and d_dx(u*u/2+grav*(h+hb))
-            real dh_u_dx  = 0;
-            real dutend_dx  = 0;
-            for (int s=0; s<ngll; s++) {
-              dh_u_dx   += deriv_matrix(s,ii) * h_u_DTs (kt,s);
-              dutend_dx += deriv_matrix(s,ii) * ( u_u_DTs(kt,s)/2 + grav*surf_DTs(kt,s) );
-            }
-            dh_u_dx   /= dx;
-            dutend_dx /= dx;
-            h_DTs(kt+1,ii) = -( dh_u_dx         ) / (kt+1);
-            u_DTs(kt+1,ii) = -( dutend_dx       ) / (kt+1);
-            if (sim1d) {
-              v_DTs(kt+1,ii) = 0;
+      for (int k=k_beg; k <= k_end; k++) {
+        // An inactive tile only needs its last cell's upper limits between its two end interfaces
+        if (! tile_active && k > k_beg && k < k_end-1) { continue; }
+        int j = dj*k + di*t;
+        int i = di*k + dj*t;
+        if (k < n) {
+          reconstruct_cell_limits<DIR,BC>( state , bath , bath_gll_n , j , i , n , bnd_lo , bnd_hi , dn , dt , grav ,
+                                           sim1d , s2g , s2d2g , c2g , c2d2g , deriv_matrix , gllWts_ngll , idl ,
+                                           sigma , weno_recon , lim_R , lim_next , tend_t );
+        }
+        if (! tile_active && k > k_beg && k < k_end) {
+          lim_L = lim_next;
+          continue;
+        }
+        // The limits across this rank's first and last interfaces come from the BC policy on a physical
+        // boundary, or else from the edge exchange
+        if (k == 0) {
+          if (bnd_lo) {
+            if (BC::periodic) {
+              reconstruct_cell_limits<DIR,BC>( state , bath , bath_gll_n , dj*(n-1)+di*t , di*(n-1)+dj*t , n ,
+                                               bnd_lo , bnd_hi , dn , dt , grav , sim1d , s2g , s2d2g , c2g , c2d2g ,
+                                               deriv_matrix , gllWts_ngll , idl , sigma , weno_recon , lim_skip ,
+                                               lim_L , tend_skip );
+            } else if (BC::nested) {
+              constant_cell_limits<DIR>( state , bath , j-dj , i-di , lim_L );
             } else {
-              v_DTs(kt+1,ii) = -( u_dv_DTs(kt,ii) ) / (kt+1);
+              lim_L = lim_R;
             }
+            if (BC::reflect) { lim_L(idN) = 0;  lim_R(idN) = 0; }
+          } else {
+            for (int v=0; v < num_edge; v++) { lim_L(v) = edges(v,0,0,t); }
           }
-          if (bc_x == BC_WALL) {
-            if (i == nx-1) u_DTs(kt+1,ngll-1) = 0;
-            if (i == 0   ) u_DTs(kt+1,0     ) = 0;
-          }
-          // Compute h*u, u*u, h+b, and u_dv_DTs at kt+1
-          for (int ii=0; ii<ngll; ii++) {
-            // bathymetry has no time derivatives (no earthquakes...)
-            surf_DTs(kt+1,ii) = h_DTs(kt+1,ii);
-            // Differentiate v at kt+1 to get dv at kt+1
-            real dv_dx = 0;
-            for (int s=0; s<ngll; s++) {
-              dv_dx += deriv_matrix(s,ii) * v_DTs(kt+1,s);
-            }
-            dv_dx /= dx;
-            dv_DTs(kt+1,ii) = dv_dx;
-            // Compute h*u, u*u, and u*dv
-            h_u_DTs (kt+1,ii) = 0;
-            u_u_DTs (kt+1,ii) = 0;
-            u_dv_DTs(kt+1,ii) = 0;
-            for (int rt=0; rt <= kt+1; rt++) {
-              h_u_DTs (kt+1,ii) += h_DTs(rt,ii) * u_DTs (kt+1-rt,ii);
-              u_u_DTs (kt+1,ii) += u_DTs(rt,ii) * u_DTs (kt+1-rt,ii);
-              u_dv_DTs(kt+1,ii) += u_DTs(rt,ii) * dv_DTs(kt+1-rt,ii);
+        }
+        if (k == n) {
+          if (bnd_hi) {
+            if (BC::periodic) {
+              reconstruct_cell_limits<DIR,BC>( state , bath , bath_gll_n , di*t , dj*t , n , bnd_lo , bnd_hi , dn ,
+                                               dt , grav , sim1d , s2g , s2d2g , c2g , c2d2g , deriv_matrix ,
+                                               gllWts_ngll , idl , sigma , weno_recon , lim_R , lim_skip , tend_skip );
+            } else if (BC::nested) {
+              constant_cell_limits<DIR>( state , bath , j , i , lim_R );
+            } else {
+              lim_R = lim_L;
             }
-          }
-          if (bc_x == BC_WALL) {
-            if (i == nx-1) h_u_DTs (kt+1,ngll-1) = 0;
-            if (i == nx-1) u_u_DTs (kt+1,ngll-1) = 0;
-            if (i == nx-1) u_dv_DTs(kt+1,ngll-1) = 0;
-            if (i == 0   ) h_u_DTs (kt+1,0     ) = 0;
-            if (i == 0   ) u_u_DTs (kt+1,0     ) = 0;
-            if (i == 0   ) u_dv_DTs(kt+1,0     ) = 0;
+            if (BC::reflect) { lim_L(idN) = 0;  lim_R(idN) = 0; }
+          } else {
+            for (int v=0; v < num_edge; v++) { lim_R(v) = edges(v,1,1,t); }
           }
         }
-      }
-
-      if (time_avg) {
-        // Compute time averages
-        for (int ii=0; ii<ngll; ii++) {
-          real dtmult = 1;
-          real h_tavg    = 0;
-          real u_tavg    = 0;
-          real v_tavg    = 0;
-          real surf_tavg = 0;
-          real u_dv_tavg = 0;
-          real h_u_tavg  = 0;
-          real u_u_tavg  = 0;
-          for (int kt=0; kt<nAder; kt++) {
-            h_tavg      += h_DTs   (kt,ii) * dtmult / (kt+1);
-            u_tavg      += u_DTs   (kt,ii) * dtmult / (kt+1);
-            v_tavg      += v_DTs   (kt,ii) * dtmult / (kt+1);
-            surf_tavg   += surf_DTs(kt,ii) * dtmult / (kt+1);
-            u_dv_tavg   += u_dv_DTs(kt,ii) * dtmult / (kt+1);
-            h_u_tavg    += h_u_DTs (kt,ii) * dtmult / (kt+1);
-            u_u_tavg    += u_u_DTs (kt,ii) * dtmult / (kt+1);
-            dtmult *= dt;
+        real fw_h, fw_n, fw_t_L, fw_t_R;
+        split_flux_difference( lim_L(idH) , lim_L(idN) , lim_L(idT) , lim_L(idSurf) , lim_L(idHN) , lim_L(idNN) ,
+                               lim_R(idH) , lim_R(idN) , lim_R(idT) , lim_R(idSurf) , lim_R(idHN) , lim_R(idNN) ,
+                               grav , sim1d , fw_h , fw_n , fw_t_L , fw_t_R );
+        if (! tile_active) {
+          // The flux enters the tile's first cell at its lower end, and leaves its last cell at its upper end
+          int  jc  = k == k_beg ? j : j-dj;
+          int  ic  = k == k_beg ? i : i-di;
+          real sgn = k == k_beg ? 1 : -1;
+          tend(idH,jc,ic) += sgn * fw_h / dn;
+          for (int tr=0; tr < num_tracers; tr++) {
+            tend(idTr+tr,jc,ic) += sgn * fw_h * ( fw_h > 0 ? lim_L(idTr+tr) : lim_R(idTr+tr) ) / dn;
           }
-          h_DTs   (0,ii) = h_tavg;
-          u_DTs   (0,ii) = u_tavg;
-          v_DTs   (0,ii) = v_tavg;
-          surf_DTs(0,ii) = surf_tavg;
-          u_dv_DTs(0,ii) = u_dv_tavg;
-          h_u_DTs (0,ii) = h_u_tavg;
-          u_u_DTs (0,ii) = u_u_tavg;
+          lim_L = lim_next;
+          continue;
         }
-      }
-
-      // Store edge estimates of h and u into the fwaves object
-      fwaves (idH,1,j,i  ) = h_DTs   (0,0     );
-      fwaves (idH,0,j,i+1) = h_DTs   (0,ngll-1);
-      fwaves (idU,1,j,i  ) = u_DTs   (0,0     );
-      fwaves (idU,0,j,i+1) = u_DTs   (0,ngll-1);
-      fwaves (idV,1,j,i  ) = v_DTs   (0,0     );
-      fwaves (idV,0,j,i+1) = v_DTs   (0,ngll-1);
-      surf_limits(1,j,i  ) = surf_DTs(0,0     );
-      surf_limits(0,j,i+1) = surf_DTs(0,ngll-1);
-      h_u_limits (1,j,i  ) = h_u_DTs (0,0     );
-      h_u_limits (0,j,i+1) = h_u_DTs (0,ngll-1);
-      u_u_limits (1,j,i  ) = u_u_DTs (0,0     );
-      u_u_limits (0,j,i+1) = u_u_DTs (0,ngll-1);
-
-      // Compute the "centered" contribution to the high-order tendency
-      if (! sim1d) {
-        real tmp = 0;
-        for (int ii=0; ii<ngll; ii++) {
-          tmp += -u_dv_DTs(0,ii) * gllWts_ngll(ii);
+        if (k > k_beg) {
+          tend(idH,j-dj,i-di) = -( fw_h        - fw_h_prev ) / dn;
+          tend(idN,j-dj,i-di) = -( fw_n        - fw_n_prev ) / dn;
+          tend(idT,j-dj,i-di) = tend_t_prev + ( -( fw_t_R_prev + fw_t_L ) / dn );
+        }
+        // Tracers are carried by the mass flux at the upwind concentration
+        for (int tr=0; tr < num_tracers; tr++) {
+          real fw_c = fw_h * ( fw_h > 0 ? lim_L(idTr+tr) : lim_R(idTr+tr) );
+          if (k > k_beg) { tend(idTr+tr,j-dj,i-di) = -( fw_c - fw_c_prev(tr) ) / dn; }
+          fw_c_prev(tr) = fw_c;
         }
-        tend(idV,j,i) = tmp;
+        fw_h_prev   = fw_h;
+        fw_n_prev   = fw_n;
+        fw_t_R_prev = fw_t_R;
+        tend_t_prev = tend_t;
+        lim_L       = lim_next;
       }
+    });
+    TIMER_STOP("recon_riemann");
 
-    }); // Loop over cells
+  }
 
-    // BCs for fwaves and surf_limits
-    if (use_mpi) {
-      
-      #ifdef __ENABLE_MPI__
-        exch.edge_init();
-        exch.edge_pack_x( fwaves , surf_limits , h_u_limits , u_u_limits );
-        exch.edge_exchange_x();
-        exch.edge_unpack_x( fwaves , surf_limits , h_u_limits , u_u_limits );
-        exch.edge_finalize();
-        if (bc_x == BC_WALL || bc_x == BC_OPEN) {
-          if (px == 0) {
-            parallel_for( ny , YAKL_LAMBDA (int j) {
-              for (int l=0; l < num_state; l++) {
-                fwaves(l,0,j,0 ) = fwaves(l,1,j,0 );
-                if (bc_x == BC_WALL && l == idU) {
-                  fwaves(l,0,j,0 ) = 0;
-                  fwaves(l,1,j,0 ) = 0;
-                }
-              }
-              surf_limits(0,j,0 ) = surf_limits(1,j,0 );
-              h_u_limits (0,j,0 ) = h_u_limits (1,j,0 );
-              u_u_limits (0,j,0 ) = u_u_limits (1,j,0 );
-            });
-          }
-          if (px == nproc_x-1) {
-            parallel_for( ny , YAKL_LAMBDA (int j) {
-              for (int l=0; l < num_state; l++) {
-                fwaves(l,1,j,nx) = fwaves(l,0,j,nx);
-                if (bc_x == BC_WALL && l == idU) {
-                  fwaves(l,0,j,nx) = 0;
-                  fwaves(l,1,j,nx) = 0;
-                }
-              }
-              surf_limits(1,j,nx) = surf_limits(0,j,nx);
-              h_u_limits (1,j,nx) = h_u_limits (0,j,nx);
-              u_u_limits (1,j,nx) = u_u_limits (0,j,nx);
-            });
-          }
-        }
-      #endif
 
-    } else { 
-
-      parallel_for( ny , YAKL_LAMBDA (int j) {
-        if (bc_x == BC_WALL || bc_x == BC_OPEN) {
-          for (int l=0; l < num_state; l++) {
-            fwaves(l,0,j,0 ) = fwaves(l,1,j,0 );
-            fwaves(l,1,j,nx) = fwaves(l,0,j,nx);
-            if (bc_x == BC_WALL && l == idU) {
-              fwaves(l,0,j,0 ) = 0;
-              fwaves(l,1,j,0 ) = 0;
-              fwaves(l,0,j,nx) = 0;
-              fwaves(l,1,j,nx) = 0;
-            }
-            surf_limits(0,j,0 ) = surf_limits(1,j,0 );
-            surf_limits(1,j,nx) = surf_limits(0,j,nx);
-            h_u_limits (0,j,0 ) = h_u_limits (1,j,0 );
-            h_u_limits (1,j,nx) = h_u_limits (0,j,nx);
-            u_u_limits (0,j,0 ) = u_u_limits (1,j,0 );
-            u_u_limits (1,j,nx) = u_u_limits (0,j,nx);
-          }
-        } else if (bc_x == BC_PERIODIC) {
-          for (int l=0; l < num_state; l++) {
-            fwaves(l,0,j,0 ) = fwaves(l,0,j,nx);
-            fwaves(l,1,j,nx) = fwaves(l,1,j,0 );
-          }
-          surf_limits(0,j,0 ) = surf_limits(0,j,nx);
-          surf_limits(1,j,nx) = surf_limits(1,j,0 );
-          h_u_limits (0,j,0 ) = h_u_limits (0,j,nx);
-          h_u_limits (1,j,nx) = h_u_limits (1,j,0 );
-          u_u_limits (0,j,0 ) = u_u_limits (0,j,nx);
-          u_u_limits (1,j,nx) = u_u_limits (1,j,0 );
-        }
-      });
-    }
+  // Output variable name of the concentration of passive tracer tr
+  static std::string tracer_name(int tr) { return "tracer_" + std::to_string(tr+1); }
 
-    // Split the flux difference into characteristic waves
-    parallel_for( SimpleBounds<2>(ny,nx+1) , YAKL_LAMBDA (int j, int i) {
-      // State values for left and right
-      real h_L  = fwaves     (idH,0,j,i);
-      real u_L  = fwaves     (idU,0,j,i);
-      real v_L  = fwaves     (idV,0,j,i);
-      real hs_L = surf_limits(    0,j,i);  // Surface height
-      real hu_L = h_u_limits (    0,j,i);  // h*u
-      real uu_L = u_u_limits (    0,j,i);  // u*u
-      real h_R  = fwaves     (idH,1,j,i);
-      real u_R  = fwaves     (idU,1,j,i);
-      real v_R  = fwaves     (idV,1,j,i);
-      real hs_R = surf_limits(    1,j,i);  // Surface height
-      real hu_R = h_u_limits (    1,j,i);  // h*u
-      real uu_R = u_u_limits (    1,j,i);  // u*u
-      // Compute interface linearly averaged values for the state
-      real h = 0.5_fp * (h_L + h_R);
-      real u = 0.5_fp * (u_L + u_R);
-      real v = 0.5_fp * (v_L + v_R);
-      real gw = sqrt(grav*h);
-      if (gw > 0) {
-        // Compute flux difference splitting for v
-        fwaves(idV,0,j,i) = 0;
-        fwaves(idV,1,j,i) = 0;
-        if (! sim1d) {
-          if (u < 0) {
-            fwaves(idV,0,j,i) += u*(v_R - v_L);
-          } else {
-            fwaves(idV,1,j,i) += u*(v_R - v_L);
-          }
-        }
 
-        // Compute left and right flux for h and u
-        real f1_L = hu_L;
-        real f1_R = hu_R;
-        real f2_L = uu_L*0.5_fp + grav*hs_L;
-        real f2_R = uu_R*0.5_fp + grav*hs_R;
-        // Compute left and right flux-based characteristic variables
-        real w1_L = 0.5_fp * f1_L - h*f2_L/(2*gw);
-        real w1_R = 0.5_fp * f1_R - h*f2_R/(2*gw);
-        real w2_L = 0.5_fp * f1_L + h*f2_L/(2*gw);
-        real w2_R = 0.5_fp * f1_R + h*f2_R/(2*gw);
-        // Compute upwind flux-based characteristic variables
-        real w1_U, w2_U;
-        // Wave 1 (u-gw)
-        if (u-gw > 0) {
-          w1_U = w1_L;
-        } else {
-          w1_U = w1_R;
+
+  // Names of the time-dependent output fields a stream can select
+  std::vector<std::string> output_field_names() const {
+    std::vector<std::string> names = { "thickness" , "u" , "v" , "surface" };
+    for (int tr=0; tr < num_tracers; tr++) { names.push_back(tracer_name(tr)); }
+    return names;
+  }
+
+
+
+  // Value of output field f, an index into output_field_names() or out_bath for the bathymetry, at cell (j,i)
+  YAKL_INLINE static real output_value(int f, StateArr const &state, real2d const &bath, int j, int i) {
+    real h = state(idH,hs+j,hs+i);
+    if (f == out_bath) { return bath(hs+j,hs+i); }
+    if (f == 0       ) { return h; }
+    if (f == 1       ) { return state(idU,hs+j,hs+i); }
+    if (f == 2       ) { return state(idV,hs+j,hs+i); }
+    if (f == 3       ) { return h + bath(hs+j,hs+i); }
+    return h > eps ? state(idTr+f-4,hs+j,hs+i) / h : 0;
+  }
+
+
+
+  // Read the output streams: stream 0 is out_file with every field at full resolution, and output_streams adds
+  // any others. Each stream's region is decimated by its stride, and each rank writes the points in its cells.
+  void init_streams(YAML::Node const &config) {
+    std::vector<std::string> names = output_field_names();
+
+    // Format of every stream, and the NetCDF-4 compression a stream uses unless it sets its own
+    std::string out_format   = "classic";
+    int         out_deflate  = 1;
+    bool        out_shuffle  = true;
+    int         out_quantize = 0;
+    if (config["out_format"  ]) { out_format   = config["out_format"  ].as<std::string>(); }
+    if (config["out_deflate" ]) { out_deflate  = config["out_deflate" ].as<int>(); }
+    if (config["out_shuffle" ]) { out_shuffle  = config["out_shuffle" ].as<bool>(); }
+    if (config["out_quantize"]) { out_quantize = config["out_quantize"].as<int>(); }
+    if      (out_format == "classic") { out_netcdf4 = false; }
+    else if (out_format == "netcdf4") { out_netcdf4 = true;  }
+    else { endrun("ERROR: out_format must be classic or netcdf4"); }
+    #ifndef __ENABLE_NETCDF4__
+      if (out_netcdf4) { endrun("ERROR: out_format: netcdf4 with MPI needs a build with -D__ENABLE_NETCDF4_PAR__"); }
+    #endif
+
+    streams = std::vector<OutputStream>(1);
+    streams[0].file    = out_file;
+    streams[0].freq    = 0;
+    streams[0].stride  = 1;
+    streams[0].single  = false;
+    streams[0].deflate = out_deflate;
+    streams[0].shuffle = out_shuffle;
+    streams[0].nsb     = out_quantize;
+    streams[0].i0 = 0;  streams[0].i1 = nx_glob;
+    streams[0].j0 = 0;  streams[0].j1 = ny_glob;
+    for (int f=0; f < (int) names.size(); f++) { streams[0].fields.push_back(f); }
+    if (config["output_streams"]) {
+      for (auto const &node : config["output_streams"]) {
+        OutputStream st;
+        if ( !node["file"] ) { endrun("ERROR: Each output stream needs a file entry"); }
+        if ( !node["freq"] ) { endrun("ERROR: Each output stream needs a freq entry"); }
+        st.file   = node["file"].as<std::string>();
+        st.freq   = node["freq"].as<real_acc>();
+        st.stride  = 1;
+        st.single  = false;
+        st.deflate = out_deflate;
+        st.shuffle = out_shuffle;
+        st.nsb     = out_quantize;
+        st.i0 = 0;  st.i1 = nx_glob;
+        st.j0 = 0;  st.j1 = ny_glob;
+        if (node["stride"  ]) { st.stride  = node["stride"  ].as<int>(); }
+        if (node["float32" ]) { st.single  = node["float32" ].as<bool>(); }
+        if (node["deflate" ]) { st.deflate = node["deflate" ].as<int>(); }
+        if (node["shuffle" ]) { st.shuffle = node["shuffle" ].as<bool>(); }
+        if (node["quantize"]) { st.nsb     = node["quantize"].as<int>(); }
+        if (node["region" ]) {
+          std::vector<int> region = node["region"].as<std::vector<int>>();
+          if (region.size() != 4) { endrun("ERROR: An output stream's region is [i_beg, i_end, j_beg, j_end]"); }
+          st.i0 = region[0];  st.i1 = region[1];
+          st.j0 = region[2];  st.j1 = region[3];
         }
-        // Wave 2 (u+gw)
-        if (u+gw > 0) {
-          w2_U = w2_L;
+        if (node["fields"]) {
+          for (auto const &name : node["fields"].as<std::vector<std::string>>()) {
+            int f = std::find( names.begin() , names.end() , name ) - names.begin();
+            if (f == (int) names.size()) { endrun("ERROR: Unknown output field " + name); }
+            st.fields.push_back(f);
+          }
         } else {
-          w2_U = w2_R;
+          for (int f=0; f < (int) names.size(); f++) { st.fields.push_back(f); }
         }
-        fwaves(idH,0,j,i) = w1_U + w2_U;
-        fwaves(idU,0,j,i) = -w1_U*gw/h + w2_U*gw/h;
-      } else {
-        fwaves(idV,0,j,i) = 0;
-        fwaves(idV,1,j,i) = 0;
-        fwaves(idH,0,j,i) = 0;
-        fwaves(idU,0,j,i) = 0;
+        if (st.freq <= 0 || st.stride < 1 || st.fields.empty()) { endrun("ERROR: Invalid output stream"); }
+        if (st.i0 < 0 || st.i1 > nx_glob || st.i0 >= st.i1 || st.j0 < 0 || st.j1 > ny_glob || st.j0 >= st.j1) {
+          endrun("ERROR: An output stream's region must lie within the domain");
+        }
+        streams.push_back(st);
       }
-    });
+    }
 
-    // Apply the tendencies
-    parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-      if (l == idH || l == idU) {
-        tend(l,j,i) = -( fwaves(l,0,j,i+1) - fwaves(l,0,j,i) ) / dx;
+    int nbuf = async_output ? output_buffers : 1;
+    for (int s=0; s < (int) streams.size(); s++) {
+      OutputStream &st = streams[s];
+      if (st.deflate < 0 || st.deflate > 9) { endrun("ERROR: An output deflate level must be from 0 to 9"); }
+      if (st.nsb < 0) { endrun("ERROR: An output quantize must be the number of significant bits to keep"); }
+      decimate( st.i0 , st.i1 , st.stride , i_beg , nx , st.nx_out , st.ix_beg , st.nx_loc , st.ci_beg );
+      decimate( st.j0 , st.j1 , st.stride , j_beg , ny , st.ny_out , st.iy_beg , st.ny_loc , st.cj_beg );
+      int nf = st.fields.size();
+      if (st.single) {
+        st.dev_f  = float3d("out_dev",nf,st.ny_loc,st.nx_loc);
+        st.host_f = std::vector<floatHost3d>(nbuf);
+        for (int b=0; b < nbuf; b++) { st.host_f[b] = floatHost3d("out_host",nf,st.ny_loc,st.nx_loc); }
       } else {
-        tend(l,j,i) += -( fwaves(l,1,j,i) + fwaves(l,0,j,i+1) ) / dx;
+        st.dev_r  = real3d("out_dev",nf,st.ny_loc,st.nx_loc);
+        st.host_r = std::vector<realHost3d>(nbuf);
+        for (int b=0; b < nbuf; b++) { st.host_r[b] = realHost3d("out_host",nf,st.ny_loc,st.nx_loc); }
       }
-    });
-
+      st.next    = 0;
+      st.num_out = 0;
+      st.rec     = -1;
+      st.ncid    = -1;
+    }
   }
 
 
 
-  // Compute state and tendency time derivatives from the state
-  void compute_tendencies_dimsplit_Y( StateArr &state , TendArr &tend , real dt ) {
-    YAKL_SCOPE( bc_y         , this->bc_y               );
-    YAKL_SCOPE( ny           , this->ny                 );
-    YAKL_SCOPE( dy           , this->dy                 );
-    YAKL_SCOPE( bath         , this->bath               );
-    YAKL_SCOPE( s2g          , this->sten_to_gll        );
-    YAKL_SCOPE( s2d2g        , this->sten_to_deriv_gll  );
-    YAKL_SCOPE( c2g          , this->coefs_to_gll       );
-    YAKL_SCOPE( c2d2g        , this->coefs_to_deriv_gll );
-    YAKL_SCOPE( deriv_matrix , this->deriv_matrix       );
-    YAKL_SCOPE( fwaves       , this->fwaves             );
-    YAKL_SCOPE( surf_limits  , this->surf_limits        );
-    YAKL_SCOPE( h_v_limits   , this->h_v_limits         );
-    YAKL_SCOPE( v_v_limits   , this->v_v_limits         );
-    YAKL_SCOPE( grav         , this->grav               );
-    YAKL_SCOPE( gllWts_ngll  , this->gllWts_ngll        );
-    YAKL_SCOPE( idl          , this->idl                );
-    YAKL_SCOPE( sigma        , this->sigma              );
-    YAKL_SCOPE( weno_recon   , this->weno_recon         );
-    YAKL_SCOPE( sim1d        , this->sim1d              );
-    YAKL_SCOPE( use_mpi      , this->use_mpi            );
-    YAKL_SCOPE( bath_gll_y   , this->bath_gll_y         );
+  // Points c0, c0+stride, ... below c1 along one direction: their number, and the index of the first one among
+  // the n cells from beg, how many there are, and the local cell it's in
+  static void decimate(int c0, int c1, int stride, long beg, int n, int &n_out, int &g_beg, int &n_loc, int &c_beg) {
+    n_out = (c1 - c0 + stride - 1) / stride;
+    long lo = beg   - c0;
+    long hi = beg+n - c0;
+    g_beg = lo <= 0 ? 0 : std::min( (long) n_out , (lo + stride - 1) / stride );
+    int g_end = hi <= 0 ? 0 : std::min( (long) n_out , (hi + stride - 1) / stride );
+    n_loc = std::max( g_end - g_beg , 0 );
+    c_beg = c0 + g_beg*stride - beg;
+  }
 
-    // y-direction boundaries
-    if (use_mpi) {
-      
-      #ifdef __ENABLE_MPI__
-        exch.halo_init();
-        exch.halo_pack_y(state);
-        exch.halo_exchange_y();
-        exch.halo_unpack_y(state);
-        exch.halo_finalize();
-        if (bc_y == BC_WALL || bc_y == BC_OPEN) {
-          if (py == 0) {
-            parallel_for( SimpleBounds<3>(num_state,hs,nx) , YAKL_LAMBDA (int l, int jj, int i) {
-              state(l,      jj,hs+i) = state(l,hs     ,hs+i);
-              if (bc_y == BC_WALL && l == idV) {
-                state(l,      jj,hs+i) = 0;
-              }
-            });
-          }
-          if (py == nproc_y-1) {
-            parallel_for( SimpleBounds<3>(num_state,hs,nx) , YAKL_LAMBDA (int l, int jj, int i) {
-              state(l,ny+hs+jj,hs+i) = state(l,hs+ny-1,hs+i);
-              if (bc_y == BC_WALL && l == idV) {
-                state(l,ny+hs+jj,hs+i) = 0;
-              }
-            });
-          }
-        }
-      #endif
 
-    } else {
 
-      parallel_for( SimpleBounds<3>(num_state,hs,nx) , YAKL_LAMBDA (int l, int jj, int i) {
-        if        (bc_y == BC_WALL || bc_y == BC_OPEN) {
-          state(l,      jj,hs+i) = state(l,hs     ,hs+i);
-          state(l,ny+hs+jj,hs+i) = state(l,hs+ny-1,hs+i);
-          if (bc_y == BC_WALL && l == idV) {
-            state(l,      jj,hs+i) = 0;
-            state(l,ny+hs+jj,hs+i) = 0;
-          }
-        } else if (bc_y == BC_PERIODIC) {
-          state(l,      jj,hs+i) = state(l,ny+jj,hs+i);
-          state(l,ny+hs+jj,hs+i) = state(l,hs+jj,hs+i);
-        }
-      });
+  // Write stream 0 and, when the file is created, the initial time level of every other stream, the gauges'
+  // initial sample, and the initial state of the envelope statistics
+  void output(StateArr const &state, real etime) {
+    TIMER_START("output");
+    output_stream( 0 , state , etime );
+    if (etime == 0.) {
+      for (int s=1; s < (int) streams.size(); s++) { output_stream( s , state , etime ); }
+      if (! gauges.names.empty()) { sample_gauge_stencils( state , etime ); }
+      if (! envelope.file.empty()) { init_envelope( state ); }
+    }
+    TIMER_STOP("output");
+  }
+
 
+
+  // Write the streams besides stream 0 that are due at etime. Call this after every time step.
+  void output_streams(StateArr const &state, real_acc etime) {
+    for (int s=1; s < (int) streams.size(); s++) {
+      OutputStream &st = streams[s];
+      if (etime / st.freq + 1.e-13 >= st.num_out+1) {
+        TIMER_START("output_streams");
+        output_stream( s , state , etime );
+        st.num_out++;
+        TIMER_STOP("output_streams");
+      }
     }
+  }
 
 
-    #if (ORD == 1)
-      // Split the flux difference into characteristic waves
-      parallel_for( SimpleBounds<2>(ny+1,nx) , YAKL_LAMBDA (int j, int i) {
-        // State values for left and right
-        real h_L  = state(idH,hs+j-1,hs+i);
-        real u_L  = state(idU,hs+j-1,hs+i);
-        real v_L  = state(idV,hs+j-1,hs+i);
-        real hs_L = bath (    hs+j-1,hs+i) + h_L;  // Surface height
-        real h_R  = state(idH,hs+j  ,hs+i);
-        real u_R  = state(idU,hs+j  ,hs+i);
-        real v_R  = state(idV,hs+j  ,hs+i);
-        real hs_R = bath (    hs+j  ,hs+i) + h_R;  // Surface height
-        // Compute interface linearly averaged values for the state
-        real h = 0.5_fp * (h_L + h_R);
-        real u = 0.5_fp * (u_L + u_R);
-        real v = 0.5_fp * (v_L + v_R);
-        real gw = sqrt(grav*h);
-        if (gw > 0) {
-          // Compute flux difference splitting for u update
-          fwaves(idU,0,j,i) = 0;
-          fwaves(idU,1,j,i) = 0;
-
-          if (v < 0) {
-            fwaves(idU,0,j,i) += v*(u_R  - u_L);
-          } else {
-            fwaves(idU,1,j,i) += v*(u_R  - u_L);
-          }
 
+  // Set up the streams and gauges to continue from the checkpoint of a run at etime after nstep steps that had
+  // written num_out outputs of stream 0 after its initial one
+  void restart_output(real_acc etime, int num_out, int nstep) {
+    streams[0].num_out = num_out;
+    streams[0].rec     = num_out + 1;
+    for (int s=1; s < (int) streams.size(); s++) {
+      streams[s].num_out = (int) (etime / streams[s].freq + 1.e-13);
+      streams[s].rec     = streams[s].num_out + 1;
+    }
+    if (! gauges.names.empty()) { restart_gauges( etime , nstep ); }
+    if (! diag_file.empty()) {
+      // The diagnostics at etime are logged again if they were due
+      diag_step  = nstep;
+      diag_etime = nstep % diag_every == 0 ? etime : -1;
+      if (masterproc && truncate_log( diag_file , etime , false )) {
+        diag_log = std::make_shared<std::ofstream>( diag_file , std::ios::app );
+      }
+    }
+  }
 
-          // Compute left and right flux for h and v
-          real f1_L = h_L*v_L;
-          real f1_R = h_R*v_R;
-          real f3_L = v_L*v_L*0.5_fp + grav*hs_L;
-          real f3_R = v_R*v_R*0.5_fp + grav*hs_R;
-          // Compute left and right flux-based characteristic variables
-          real w1_L = 0.5_fp * f1_L - h*f3_L/(2*gw);
-          real w1_R = 0.5_fp * f1_R - h*f3_R/(2*gw);
-          real w2_L = 0.5_fp * f1_L + h*f3_L/(2*gw);
-          real w2_R = 0.5_fp * f1_R + h*f3_R/(2*gw);
-          // Compute upwind flux-based characteristic variables
-          real w1_U, w2_U;
-          // Wave 1 (v-gw)
-          if (v-gw > 0) {
-            w1_U = w1_L;
-          } else {
-            w1_U = w1_R;
-          }
-          // Wave 2 (v+gw)
-          if (v+gw > 0) {
-            w2_U = w2_L;
-          } else {
-            w2_U = w2_R;
-          }
-          fwaves(idH,0,j,i) = w1_U + w2_U;
-          fwaves(idV,0,j,i) = -w1_U*gw/h + w2_U*gw/h;
-        } else {
-          fwaves(idU,0,j,i) = 0;
-          fwaves(idU,1,j,i) = 0;
-          fwaves(idH,0,j,i) = 0;
-          fwaves(idV,0,j,i) = 0;
-        }
+
+
+  void output_stream(int s, StateArr const &state, real etime) {
+    if (streams[s].single) { output_stream( s , state , etime , streams[s].dev_f , streams[s].host_f ); }
+    else                   { output_stream( s , state , etime , streams[s].dev_r , streams[s].host_r ); }
+  }
+
+
+
+  // Stage a stream's fields in one pass over its points, reduced and converted to the stored type on the
+  // device, then write them, either right away or on the background writer. The writer's bounded queue holds
+  // back the model when all the host buffers are still waiting to be written.
+  template <class T>
+  void output_stream(int s, StateArr const &state, real etime, yakl::Array<T,3,memDevice,yakl::styleC> const &dev,
+                     std::vector<yakl::Array<T,3,memHost,yakl::styleC>> const &host) {
+    YAKL_SCOPE( bath , this->bath );
+    OutputStream &st = streams[s];
+    int stride = st.stride;
+    int ci_beg = st.ci_beg;
+    int cj_beg = st.cj_beg;
+    int nf     = st.fields.size();
+    SArray<int,1,num_out_fields> fields;
+    for (int k=0; k < nf; k++) { fields(k) = st.fields[k]; }
+
+    parallel_for( SimpleBounds<3>(nf,st.ny_loc,st.nx_loc) , YAKL_LAMBDA (int k, int jj, int ii) {
+      dev(k,jj,ii) = output_value( fields(k) , state , bath , cj_beg+jj*stride , ci_beg+ii*stride );
+    });
+
+    // The bathymetry is only written when the file is created
+    yakl::Array<T,3,memHost,yakl::styleC> bath_host;
+    if (etime == 0.) {
+      yakl::Array<T,3,memDevice,yakl::styleC> bath_dev("bath_dev",1,st.ny_loc,st.nx_loc);
+      parallel_for( SimpleBounds<2>(st.ny_loc,st.nx_loc) , YAKL_LAMBDA (int jj, int ii) {
+        bath_dev(0,jj,ii) = output_value( out_bath , state , bath , cj_beg+jj*stride , ci_beg+ii*stride );
       });
+      bath_host = bath_dev.createHostCopy();
+    }
 
-      // Apply the tendencies
-      parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-        if (l == idH || l == idV) {
-          tend(l,j,i) = -( fwaves(l,0,j+1,i) - fwaves(l,0,j,i) ) / dy;
-        } else {
-          tend(l,j,i) = -( fwaves(l,1,j,i) + fwaves(l,0,j+1,i) ) / dy;
+    if (writer) { writer->reserve(); }
+    yakl::Array<T,3,memHost,yakl::styleC> fields_host = host[st.next];
+    st.next = (st.next+1) % host.size();
+    dev.deep_copy_to(fields_host);
+    yakl::fence();
+
+    if (writer) {
+      writer->submit( [this,s,fields_host,bath_host,etime] () {
+        TIMER_START("write_stream");
+        write_stream(s,fields_host,bath_host,etime);
+        TIMER_STOP("write_stream");
+      } );
+    } else {
+      TIMER_START("write_stream");
+      write_stream(s,fields_host,bath_host,etime);
+      TIMER_STOP("write_stream");
+    }
+  }
+
+
+
+  // Write a stream's staged fields to its file, creating it when etime is zero. Apart from the stream's file
+  // handle and time level, this only reads the host buffers and the model's fixed configuration, so it can run
+  // on the background writer.
+  template <class T>
+  void write_stream(int s, yakl::Array<T,3,memHost,yakl::styleC> const &fields,
+                    yakl::Array<T,3,memHost,yakl::styleC> const &bath_host, real etime) {
+    typedef yakl::Array<T,1,memHost,yakl::styleC> Host1d;
+    OutputStream &st = streams[s];
+    std::vector<std::string> names = output_field_names();
+    int nx_loc = st.nx_loc;
+    int ny_loc = st.ny_loc;
+
+    // Coordinates of this rank's points
+    Host1d xloc("xloc",nx_loc);
+    Host1d yloc("yloc",ny_loc);
+    for (int i=0; i < nx_loc; i++) { xloc(i) = (st.i0 + (st.ix_beg+i)*st.stride + 0.5)*dx; }
+    for (int j=0; j < ny_loc; j++) { yloc(j) = (st.j0 + (st.iy_beg+j)*st.stride + 0.5)*dy; }
+
+    if (out_netcdf4) {
+      #ifdef __ENABLE_NETCDF4__
+        // Create the file or open the existing one of a restarted run, and keep it open
+        if (etime == 0. || st.ncid < 0) { open_stream_nc4( st , etime == 0. ); }
+
+        // Every write is collective in MPI runs, so ranks with none of the stream's points write nothing
+        bool   mine     = nx_loc > 0 && ny_loc > 0;
+        size_t start[3] = { (size_t) st.rec , mine ? (size_t) st.iy_beg : 0 , mine ? (size_t) st.ix_beg : 0 };
+        size_t count[3] = { 1               , mine ? (size_t) ny_loc    : 0 , mine ? (size_t) nx_loc    : 0 };
+        if (etime == 0.) {
+          nc4_put( st , 0 , &start[2] , &count[2] , xloc.data()      );
+          nc4_put( st , 1 , &start[1] , &count[1] , yloc.data()      );
+          nc4_put( st , 3 , &start[1] , &count[1] , bath_host.data() );
         }
-      });
+        T      t       = etime;
+        size_t start_t = masterproc ? st.rec : 0;
+        size_t count_t = masterproc ? 1      : 0;
+        nc4_put( st , 2 , &start_t , &count_t , &t );
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          nc4_put( st , 4+k , start , count , fields.data()+k*ny_loc*nx_loc );
+        }
+        // Flush the time level, so a crashed run's output stays readable
+        nc4_check( nc_sync( st.ncid ) , "sync" );
+        st.rec++;
+      #endif
       return;
-    #endif
+    }
 
-    // Loop over cells, reconstruct, compute time derivs, time average,
-    // store state edge fluxes, compute cell-centered tendencies
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
-      SArray<real,1,ord> stencil;
+    #ifdef __ENABLE_MPI__
 
-      // Reconstruct h and u
-      SArray<real,2,nAder,ngll> h_DTs;
-      SArray<real,2,nAder,ngll> u_DTs;
-      SArray<real,2,nAder,ngll> du_DTs;
-      SArray<real,2,nAder,ngll> v_DTs;
-      SArray<real,2,nAder,ngll> surf_DTs;
-      {
-        real h  = state(idH,hs+j,hs+i);
-        real gw = sqrt(grav*h);
-
-        // Reconstruct first characteristic variable stored in h
-        for (int jj=0; jj<ord; jj++) { stencil(jj) = 0.5_fp*(state(idH,j+jj,hs+i)+bath(j+jj,hs+i)) -
-                                                     h/(2*gw)*state(idV,j+jj,hs+i); }
-        reconstruct_gll_values( stencil , h_DTs , s2g , c2g , idl , sigma , weno_recon );
-
-        // Reconstruct second characteristic variable stored in v
-        for (int jj=0; jj<ord; jj++) { stencil(jj) = 0.5_fp*(state(idH,j+jj,hs+i)+bath(j+jj,hs+i)) +
-                                                     h/(2*gw)*state(idV,j+jj,hs+i); }
-        reconstruct_gll_values( stencil , v_DTs , s2g , c2g , idl , sigma , weno_recon );
-
-        for (int jj=0; jj < ngll; jj++) {
-          real w1 = h_DTs(0,jj);
-          real w2 = v_DTs(0,jj);
-          surf_DTs(0,jj) =       w1 +      w2;
-          v_DTs   (0,jj) = -gw/h*w1 + gw/h*w2;
+      // Create the file or open the existing one of a restarted run, and keep it open
+      if (etime == 0. || st.ncid < 0) { open_stream( st , etime == 0. ); }
+
+      // Post every write of this time level, then complete them together in one collective call. Ranks with
+      // none of the stream's points still take part in the collective calls.
+      MPI_Datatype type = std::is_same<T,float>::value ? MPI_FLOAT : MPI_DOUBLE;
+      std::vector<int> reqs;
+      MPI_Offset start[3] = { (MPI_Offset) st.rec , (MPI_Offset) st.iy_beg , (MPI_Offset) st.ix_beg };
+      MPI_Offset count[3] = { 1                   , (MPI_Offset) ny_loc    , (MPI_Offset) nx_loc    };
+      bool mine = nx_loc > 0 && ny_loc > 0;
+      if (etime == 0. && mine) {
+        iput_stream( st , 0 , &start[2] , &count[2] , xloc.data()      , nx_loc        , type , reqs );
+        iput_stream( st , 1 , &start[1] , &count[1] , yloc.data()      , ny_loc        , type , reqs );
+        iput_stream( st , 3 , &start[1] , &count[1] , bath_host.data() , ny_loc*nx_loc , type , reqs );
+      }
+      T t = etime;
+      if (masterproc) { iput_stream( st , 2 , &start[0] , &count[0] , &t , 1 , type , reqs ); }
+      if (mine) {
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          iput_stream( st , 4+k , start , count , fields.data()+k*ny_loc*nx_loc , ny_loc*nx_loc , type , reqs );
         }
       }
+      std::vector<int> stats(reqs.size());
+      ncmpi_check( ncmpi_wait_all( st.ncid , reqs.size() , reqs.data() , stats.data() ) , "wait_all" );
+      for (int r=0; r < (int) stats.size(); r++) { ncmpi_check( stats[r] , "iput_vara" ); }
+      // Keep the number of time levels in the file's header current, so a crashed run's output stays readable
+      ncmpi_check( ncmpi_sync_numrecs( st.ncid ) , "sync_numrecs" );
+      st.rec++;
 
-      for (int jj=0; jj < ngll; jj++) { h_DTs(0,jj) = surf_DTs(0,jj) - bath_gll_y(j,i,jj); }
+    #else
 
-      for (int jj=0; jj<ord; jj++) { stencil(jj) = state(idU,j+jj,hs+i); }
-      reconstruct_gll_values_and_derivs( stencil , u_DTs , du_DTs, dy , s2g , s2d2g ,
-                                         c2g , c2d2g , idl , sigma , weno_recon );
+      typedef yakl::Array<T,2,memHost,yakl::styleC> Host2d;
+      yakl::SimpleNetCDF nc;
+      int ulIndex = 0; // Unlimited dimension index to place this data at
 
-      if (bc_y == BC_WALL) {
-        if (j == ny-1) v_DTs(0,ngll-1) = 0;
-        if (j == 0   ) v_DTs(0,0     ) = 0;
-      }
+      // Create or open the file
+      if (etime == 0.) {
+        nc.create(st.file);
 
-      SArray<real,2,nAder,ngll> h_v_DTs;
-      SArray<real,2,nAder,ngll> v_du_DTs;
-      SArray<real,2,nAder,ngll> v_v_DTs;
-      for (int jj=0; jj<ngll; jj++) {
-        h_v_DTs (0,jj) = h_DTs(0,jj) * v_DTs (0,jj);
-        v_du_DTs(0,jj) = v_DTs(0,jj) * du_DTs(0,jj);
-        v_v_DTs (0,jj) = v_DTs(0,jj) * v_DTs (0,jj);
-      }
+        // Create spatial variables
+        nc.write(xloc,"x",{"x"});
+        nc.write(yloc,"y",{"y"});
 
-      if (nAder > 1) {
-        for (int kt=0; kt < nAder-1; kt++) {
-          // Compute state at kt+1
-          for (int jj=0; jj<ngll; jj++) {
-            // Compute d_dy(h*v) and d_dy(v*v/2+grav*(h+hb))
-            real dh_v_dy  = 0;
-            real dvtend_dy  = 0;
-            for (int s=0; s<ngll; s++) {
-              dh_v_dy   += deriv_matrix(s,jj) * h_v_DTs(kt,s);
-              dvtend_dy += deriv_matrix(s,jj) * ( v_v_DTs(kt,s)/2 + grav*surf_DTs(kt,s) );
-            }
-            dh_v_dy   /= dy;
-            dvtend_dy /= dy;
-            h_DTs(kt+1,jj) = -( dh_v_dy         ) / (kt+1);
-            u_DTs(kt+1,jj) = -( v_du_DTs(kt,jj) ) / (kt+1);
-            v_DTs(kt+1,jj) = -( dvtend_dy       ) / (kt+1);
-          }
-          if (bc_y == BC_WALL) {
-            if (j == ny-1) v_DTs(kt+1,ngll-1) = 0;
-            if (j == 0   ) v_DTs(kt+1,0     ) = 0;
-          }
-          // Compute h*v, v*v, h+b, and v_du_DTs at kt+1
-          for (int jj=0; jj<ngll; jj++) {
-            // bathymetry has no time derivatives (no earthquakes...)
-            surf_DTs(kt+1,jj) = h_DTs(kt+1,jj);
-            // Differentiate v at kt+1 to get dv at kt+1
-            real du_dy = 0;
-            for (int s=0; s<ngll; s++) {
-              du_dy += deriv_matrix(s,jj) * u_DTs(kt+1,s);
-            }
-            du_dy /= dy;
-            du_DTs(kt+1,jj) = du_dy;
-            // Compute h*u, u*u, and u*dv
-            h_v_DTs (kt+1,jj) = 0;
-            v_v_DTs (kt+1,jj) = 0;
-            v_du_DTs(kt+1,jj) = 0;
-            for (int rt=0; rt <= kt+1; rt++) {
-              h_v_DTs (kt+1,jj) += h_DTs(rt,jj) * v_DTs (kt+1-rt,jj);
-              v_v_DTs (kt+1,jj) += v_DTs(rt,jj) * v_DTs (kt+1-rt,jj);
-              v_du_DTs(kt+1,jj) += v_DTs(rt,jj) * du_DTs(kt+1-rt,jj);
-            }
-          }
-          if (bc_y == BC_WALL) {
-            if (j == ny-1) h_v_DTs (kt+1,ngll-1) = 0;
-            if (j == ny-1) v_v_DTs (kt+1,ngll-1) = 0;
-            if (j == ny-1) v_du_DTs(kt+1,ngll-1) = 0;
-            if (j == 0   ) h_v_DTs (kt+1,0     ) = 0;
-            if (j == 0   ) v_v_DTs (kt+1,0     ) = 0;
-            if (j == 0   ) v_du_DTs(kt+1,0     ) = 0;
-          }
-        }
+        // Write bathymetry data
+        Host2d bath2d("bath",bath_host.data(),ny_loc,nx_loc);
+        nc.write(bath2d,"bath",{"y","x"});
+
+        // Elapsed time
+        nc.write1((T) 0,"t",0,"t");
+      } else {
+        nc.open(st.file,yakl::NETCDF_MODE_WRITE);
+
+        // Write the elapsed time
+        ulIndex = st.rec >= 0 ? st.rec : nc.getDimSize("t");
+        nc.write1((T) etime,"t",ulIndex,"t");
+      }
+      // Write the data
+      for (int k=0; k < (int) st.fields.size(); k++) {
+        Host2d data("data",fields.data()+k*ny_loc*nx_loc,ny_loc,nx_loc);
+        nc.write1(data,names[st.fields[k]],{"y","x"},ulIndex,"t");
       }
 
-      if (time_avg) {
-        // Compute time averages
-        for (int ii=0; ii<ngll; ii++) {
-          real dtmult = 1;
-          real h_tavg    = 0;
-          real u_tavg    = 0;
-          real v_tavg    = 0;
-          real surf_tavg = 0;
-          real h_v_tavg  = 0;
-          real v_v_tavg  = 0;
-          real v_du_tavg = 0;
-          for (int kt=0; kt<nAder; kt++) {
-            h_tavg      += h_DTs   (kt,ii) * dtmult / (kt+1);
-            u_tavg      += u_DTs   (kt,ii) * dtmult / (kt+1);
-            v_tavg      += v_DTs   (kt,ii) * dtmult / (kt+1);
-            surf_tavg   += surf_DTs(kt,ii) * dtmult / (kt+1);
-            h_v_tavg    += h_v_DTs (kt,ii) * dtmult / (kt+1);
-            v_v_tavg    += v_v_DTs (kt,ii) * dtmult / (kt+1);
-            v_du_tavg   += v_du_DTs(kt,ii) * dtmult / (kt+1);
-            dtmult *= dt;
-          }
-          h_DTs   (0,ii) = h_tavg;
-          u_DTs   (0,ii) = u_tavg;
-          v_DTs   (0,ii) = v_tavg;
-          surf_DTs(0,ii) = surf_tavg;
-          h_v_DTs (0,ii) = h_v_tavg;
-          v_v_DTs (0,ii) = v_v_tavg;
-          v_du_DTs(0,ii) = v_du_tavg;
+      // Close the file
+      nc.close();
+      st.rec = ulIndex+1;
+
+    #endif
+  }
+
+
+
+  #ifdef __ENABLE_MPI__
+    static void ncmpi_check(int err, char const *what) {
+      if (err != NC_NOERR) { endrun( std::string("ERROR: PnetCDF ") + what + ": " + ncmpi_strerror(err) ); }
+    }
+
+
+    // Create a stream's file and define its variables, or open the existing file to append to it
+    void open_stream(OutputStream &st, bool create) {
+      std::vector<std::string> names = output_field_names();
+      nc_type type = st.single || std::is_same<real,float>::value ? NC_FLOAT : NC_DOUBLE;
+      st.varids = std::vector<int>(4+st.fields.size());
+      if (st.ncid >= 0) { ncmpi_check( ncmpi_close(st.ncid) , "close" ); }
+      if (create) {
+        ncmpi_check( ncmpi_create( io_comm , st.file.c_str() , NC_CLOBBER | NC_64BIT_DATA , MPI_INFO_NULL ,
+                                   &st.ncid ) , "create" );
+        int dim_x, dim_y, dim_t;
+        ncmpi_check( ncmpi_def_dim( st.ncid , "x" , st.nx_out    , &dim_x ) , "def_dim" );
+        ncmpi_check( ncmpi_def_dim( st.ncid , "y" , st.ny_out    , &dim_y ) , "def_dim" );
+        ncmpi_check( ncmpi_def_dim( st.ncid , "t" , NC_UNLIMITED , &dim_t ) , "def_dim" );
+        int dims_yx [2] = { dim_y , dim_x };
+        int dims_tyx[3] = { dim_t , dim_y , dim_x };
+        ncmpi_check( ncmpi_def_var( st.ncid , "x"    , type , 1 , &dim_x  , &st.varids[0] ) , "def_var" );
+        ncmpi_check( ncmpi_def_var( st.ncid , "y"    , type , 1 , &dim_y  , &st.varids[1] ) , "def_var" );
+        ncmpi_check( ncmpi_def_var( st.ncid , "t"    , type , 1 , &dim_t  , &st.varids[2] ) , "def_var" );
+        ncmpi_check( ncmpi_def_var( st.ncid , "bath" , type , 2 , dims_yx , &st.varids[3] ) , "def_var" );
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          ncmpi_check( ncmpi_def_var( st.ncid , names[st.fields[k]].c_str() , type , 3 , dims_tyx ,
+                                      &st.varids[4+k] ) , "def_var" );
+        }
+        ncmpi_check( ncmpi_enddef( st.ncid ) , "enddef" );
+        st.rec = 0;
+      } else {
+        ncmpi_check( ncmpi_open( io_comm , st.file.c_str() , NC_WRITE , MPI_INFO_NULL , &st.ncid ) , "open" );
+        ncmpi_check( ncmpi_inq_varid( st.ncid , "x"    , &st.varids[0] ) , "inq_varid" );
+        ncmpi_check( ncmpi_inq_varid( st.ncid , "y"    , &st.varids[1] ) , "inq_varid" );
+        ncmpi_check( ncmpi_inq_varid( st.ncid , "t"    , &st.varids[2] ) , "inq_varid" );
+        ncmpi_check( ncmpi_inq_varid( st.ncid , "bath" , &st.varids[3] ) , "inq_varid" );
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          ncmpi_check( ncmpi_inq_varid( st.ncid , names[st.fields[k]].c_str() , &st.varids[4+k] ) , "inq_varid" );
+        }
+        if (st.rec < 0) {
+          int        dim_t;
+          MPI_Offset nrec;
+          ncmpi_check( ncmpi_inq_dimid ( st.ncid , "t" , &dim_t ) , "inq_dimid"  );
+          ncmpi_check( ncmpi_inq_dimlen( st.ncid , dim_t , &nrec ) , "inq_dimlen" );
+          st.rec = nrec;
         }
       }
+    }
 
-      // Store edge estimates of h and u into the fwaves object
-      fwaves (idH,1,j  ,i) = h_DTs   (0,0     );
-      fwaves (idH,0,j+1,i) = h_DTs   (0,ngll-1);
-      fwaves (idU,1,j  ,i) = u_DTs   (0,0     );
-      fwaves (idU,0,j+1,i) = u_DTs   (0,ngll-1);
-      fwaves (idV,1,j  ,i) = v_DTs   (0,0     );
-      fwaves (idV,0,j+1,i) = v_DTs   (0,ngll-1);
-      surf_limits(1,j  ,i) = surf_DTs(0,0     );
-      surf_limits(0,j+1,i) = surf_DTs(0,ngll-1);
-      h_v_limits (1,j  ,i) = h_v_DTs (0,0     );
-      h_v_limits (0,j+1,i) = h_v_DTs (0,ngll-1);
-      v_v_limits (1,j  ,i) = v_v_DTs (0,0     );
-      v_v_limits (0,j+1,i) = v_v_DTs (0,ngll-1);
-
-      // Compute the "centered" contribution to the high-order tendency
-
-      real tmp = 0;
-      for (int ii=0; ii<ngll; ii++) {
-        tmp += -v_du_DTs(0,ii) * gllWts_ngll(ii);
-      }
-      tend(idU,j,i) = tmp;
 
+    // Post a nonblocking write of n values to a stream's variable v, completed by the next ncmpi_wait_all
+    template <class T>
+    void iput_stream(OutputStream const &st, int v, MPI_Offset const *start, MPI_Offset const *count, T const *buf,
+                     MPI_Offset n, MPI_Datatype type, std::vector<int> &reqs) {
+      int req;
+      ncmpi_check( ncmpi_iput_vara( st.ncid , st.varids[v] , start , count , buf , n , type , &req ) , "iput_vara" );
+      reqs.push_back(req);
+    }
+  #endif
 
-    }); // Loop over cells
 
-    // BCs for fwaves and surf_limits
-    if (use_mpi) {
-      
-      #ifdef __ENABLE_MPI__
-        exch.edge_init();
-        exch.edge_pack_y( fwaves , surf_limits , h_v_limits , v_v_limits );
-        exch.edge_exchange_y();
-        exch.edge_unpack_y( fwaves , surf_limits , h_v_limits , v_v_limits );
-        exch.edge_finalize();
-        if (bc_y == BC_WALL || bc_y == BC_OPEN) {
-          if (py == 0) {
-            parallel_for( nx , YAKL_LAMBDA (int i) {
-              for (int l=0; l < num_state; l++) {
-                fwaves(l,0,0 ,i) = fwaves(l,1,0 ,i);
-                if (bc_y == BC_WALL && l == idV) {
-                  fwaves(l,0,0 ,i) = 0;
-                  fwaves(l,1,0 ,i) = 0;
-                }
-              }
-              surf_limits(0,0 ,i) = surf_limits(1,0 ,i);
-              h_v_limits (0,0 ,i) = h_v_limits (1,0 ,i);
-              v_v_limits (0,0 ,i) = v_v_limits (1,0 ,i);
-            });
-          }
-          if (py == nproc_y-1) {
-            parallel_for( nx , YAKL_LAMBDA (int i) {
-              for (int l=0; l < num_state; l++) {
-                fwaves(l,1,ny,i) = fwaves(l,0,ny,i);
-                if (bc_y == BC_WALL && l == idV) {
-                  fwaves(l,0,ny,i) = 0;
-                  fwaves(l,1,ny,i) = 0;
-                }
-              }
-              surf_limits(1,ny,i) = surf_limits(0,ny,i);
-              h_v_limits (1,ny,i) = h_v_limits (0,ny,i);
-              v_v_limits (1,ny,i) = v_v_limits (0,ny,i);
-            });
-          }
-        }
-      #endif
 
-    } else {
+  #ifdef __ENABLE_NETCDF4__
+    static void nc4_check(int err, char const *what) {
+      if (err != NC_NOERR) { endrun( std::string("ERROR: NetCDF-4 ") + what + ": " + nc_strerror(err) ); }
+    }
 
-      parallel_for( nx , YAKL_LAMBDA (int i) {
-        if (bc_y == BC_WALL || bc_y == BC_OPEN) {
-          for (int l=0; l < num_state; l++) {
-            fwaves(l,0,0 ,i) = fwaves(l,1,0 ,i);
-            fwaves(l,1,ny,i) = fwaves(l,0,ny,i);
-            if (bc_y == BC_WALL && l == idV) {
-              fwaves(l,0,0 ,i) = 0;
-              fwaves(l,1,0 ,i) = 0;
-              fwaves(l,0,ny,i) = 0;
-              fwaves(l,1,ny,i) = 0;
-            }
-            surf_limits(0,0 ,i) = surf_limits(1,0 ,i);
-            surf_limits(1,ny,i) = surf_limits(0,ny,i);
-            h_v_limits (0,0 ,i) = h_v_limits (1,0 ,i);
-            h_v_limits (1,ny,i) = h_v_limits (0,ny,i);
-            v_v_limits (0,0 ,i) = v_v_limits (1,0 ,i);
-            v_v_limits (1,ny,i) = v_v_limits (0,ny,i);
+
+    // Create a stream's NetCDF-4 file and define its variables, or open the existing file to append to it.
+    // Each time level of bath and the fields is stored in chunks about the size of a rank's part of the
+    // stream, split further to at most max_chunk values, so each rank's write fills whole chunks that HDF5
+    // deflates independently.
+    void open_stream_nc4(OutputStream &st, bool create) {
+      size_t static constexpr max_chunk = 1 << 22;
+      std::vector<std::string> names = output_field_names();
+      nc_type type = st.single || std::is_same<real,float>::value ? NC_FLOAT : NC_DOUBLE;
+      st.varids = std::vector<int>(4+st.fields.size());
+      if (st.ncid >= 0) { nc4_check( nc_close(st.ncid) , "close" ); }
+      if (create) {
+        #ifdef __ENABLE_MPI__
+          nc4_check( nc_create_par( st.file.c_str() , NC_NETCDF4 | NC_CLOBBER , io_comm , MPI_INFO_NULL ,
+                                    &st.ncid ) , "create_par" );
+        #else
+          nc4_check( nc_create( st.file.c_str() , NC_NETCDF4 | NC_CLOBBER , &st.ncid ) , "create" );
+        #endif
+        int old_fill;
+        nc4_check( nc_set_fill( st.ncid , NC_NOFILL , &old_fill ) , "set_fill" );
+        int dim_x, dim_y, dim_t;
+        nc4_check( nc_def_dim( st.ncid , "x" , st.nx_out    , &dim_x ) , "def_dim" );
+        nc4_check( nc_def_dim( st.ncid , "y" , st.ny_out    , &dim_y ) , "def_dim" );
+        nc4_check( nc_def_dim( st.ncid , "t" , NC_UNLIMITED , &dim_t ) , "def_dim" );
+        int dims_yx [2] = { dim_y , dim_x };
+        int dims_tyx[3] = { dim_t , dim_y , dim_x };
+        nc4_check( nc_def_var( st.ncid , "x"    , type , 1 , &dim_x  , &st.varids[0] ) , "def_var" );
+        nc4_check( nc_def_var( st.ncid , "y"    , type , 1 , &dim_y  , &st.varids[1] ) , "def_var" );
+        nc4_check( nc_def_var( st.ncid , "t"    , type , 1 , &dim_t  , &st.varids[2] ) , "def_var" );
+        nc4_check( nc_def_var( st.ncid , "bath" , type , 2 , dims_yx , &st.varids[3] ) , "def_var" );
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          nc4_check( nc_def_var( st.ncid , names[st.fields[k]].c_str() , type , 3 , dims_tyx ,
+                                 &st.varids[4+k] ) , "def_var" );
+        }
+
+        int    npx     = use_mpi ? nproc_x : 1;
+        int    npy     = use_mpi ? nproc_y : 1;
+        size_t chunk_x = (st.nx_out + npx - 1) / npx;
+        size_t chunk_y = (st.ny_out + npy - 1) / npy;
+        while (chunk_x * chunk_y > max_chunk) {
+          if (chunk_x >= chunk_y) { chunk_x = (chunk_x + 1) / 2; }
+          else                    { chunk_y = (chunk_y + 1) / 2; }
+        }
+        size_t chunks[3] = { 1 , chunk_y , chunk_x };
+        for (int v=3; v < (int) st.varids.size(); v++) {
+          nc4_check( nc_def_var_chunking( st.ncid , st.varids[v] , NC_CHUNKED , v == 3 ? &chunks[1] : chunks ) ,
+                     "def_var_chunking" );
+          if (st.deflate > 0 || st.shuffle) {
+            nc4_check( nc_def_var_deflate( st.ncid , st.varids[v] , st.shuffle , st.deflate > 0 , st.deflate ) ,
+                       "def_var_deflate" );
           }
-        } else if (bc_y == BC_PERIODIC) {
-          for (int l=0; l < num_state; l++) {
-            fwaves(l,0,0 ,i) = fwaves(l,0,ny,i);
-            fwaves(l,1,ny,i) = fwaves(l,1,0 ,i);
+          // Rounding away the low bits of the fields' mantissas leaves long runs for deflate to compress
+          if (v > 3 && st.nsb > 0) {
+            #ifdef NC_QUANTIZE_BITROUND
+              nc4_check( nc_def_var_quantize( st.ncid , st.varids[v] , NC_QUANTIZE_BITROUND , st.nsb ) ,
+                         "def_var_quantize" );
+            #else
+              endrun("ERROR: Output quantization needs netCDF-C 4.9 or later");
+            #endif
           }
-          surf_limits(0,0 ,i) = surf_limits(0,ny,i);
-          surf_limits(1,ny,i) = surf_limits(1,0 ,i);
-          h_v_limits (0,0 ,i) = h_v_limits (0,ny,i);
-          h_v_limits (1,ny,i) = h_v_limits (1,0 ,i);
-          v_v_limits (0,0 ,i) = v_v_limits (0,ny,i);
-          v_v_limits (1,ny,i) = v_v_limits (1,0 ,i);
         }
-      });
-
+        set_par_access_nc4( st );
+        nc4_check( nc_enddef( st.ncid ) , "enddef" );
+        st.rec = 0;
+      } else {
+        #ifdef __ENABLE_MPI__
+          nc4_check( nc_open_par( st.file.c_str() , NC_WRITE , io_comm , MPI_INFO_NULL , &st.ncid ) ,
+                     "open_par" );
+        #else
+          nc4_check( nc_open( st.file.c_str() , NC_WRITE , &st.ncid ) , "open" );
+        #endif
+        nc4_check( nc_inq_varid( st.ncid , "x"    , &st.varids[0] ) , "inq_varid" );
+        nc4_check( nc_inq_varid( st.ncid , "y"    , &st.varids[1] ) , "inq_varid" );
+        nc4_check( nc_inq_varid( st.ncid , "t"    , &st.varids[2] ) , "inq_varid" );
+        nc4_check( nc_inq_varid( st.ncid , "bath" , &st.varids[3] ) , "inq_varid" );
+        for (int k=0; k < (int) st.fields.size(); k++) {
+          nc4_check( nc_inq_varid( st.ncid , names[st.fields[k]].c_str() , &st.varids[4+k] ) , "inq_varid" );
+        }
+        set_par_access_nc4( st );
+        if (st.rec < 0) {
+          int    dim_t;
+          size_t nrec;
+          nc4_check( nc_inq_dimid ( st.ncid , "t" , &dim_t ) , "inq_dimid"  );
+          nc4_check( nc_inq_dimlen( st.ncid , dim_t , &nrec ) , "inq_dimlen" );
+          st.rec = nrec;
+        }
+      }
     }
 
-    // Split the flux difference into characteristic waves
-    parallel_for( SimpleBounds<2>(ny+1,nx) , YAKL_LAMBDA (int j, int i) {
-      // State values for left and right
-      real h_L  = fwaves     (idH,0,j,i);
-      real u_L  = fwaves     (idU,0,j,i);
-      real v_L  = fwaves     (idV,0,j,i);
-      real hs_L = surf_limits(    0,j,i);  // Surface height
-      real hv_L = h_v_limits (    0,j,i);  // h*v
-      real vv_L = v_v_limits (    0,j,i);  // v*v
-      real h_R  = fwaves     (idH,1,j,i);
-      real u_R  = fwaves     (idU,1,j,i);
-      real v_R  = fwaves     (idV,1,j,i);
-      real hs_R = surf_limits(    1,j,i);  // Surface height
-      real hv_R = h_v_limits (    1,j,i);  // h*v
-      real vv_R = v_v_limits (    1,j,i);  // v*v
-      // Compute interface linearly averaged values for the state
-      real h = 0.5_fp * (h_L + h_R);
-      real u = 0.5_fp * (u_L + u_R);
-      real v = 0.5_fp * (v_L + v_R);
-      real gw = sqrt(grav*h);
-      if (gw > 0) {
-        // Compute flux difference splitting for u update
-        fwaves(idU,0,j,i) = 0;
-        fwaves(idU,1,j,i) = 0;
 
-        if (v < 0) {
-          fwaves(idU,0,j,i) += v*(u_R  - u_L);
-        } else {
-          fwaves(idU,1,j,i) += v*(u_R  - u_L);
+    // HDF5 only applies filters through collective writes
+    void set_par_access_nc4(OutputStream const &st) {
+      #ifdef __ENABLE_MPI__
+        for (int v=0; v < (int) st.varids.size(); v++) {
+          nc4_check( nc_var_par_access( st.ncid , st.varids[v] , NC_COLLECTIVE ) , "var_par_access" );
         }
+      #endif
+    }
 
 
-        // Compute left and right flux for h and v
-        real f1_L = hv_L;
-        real f1_R = hv_R;
-        real f3_L = vv_L*0.5_fp + grav*hs_L;
-        real f3_R = vv_R*0.5_fp + grav*hs_R;
-        // Compute left and right flux-based characteristic variables
-        real w1_L = 0.5_fp * f1_L - h*f3_L/(2*gw);
-        real w1_R = 0.5_fp * f1_R - h*f3_R/(2*gw);
-        real w2_L = 0.5_fp * f1_L + h*f3_L/(2*gw);
-        real w2_R = 0.5_fp * f1_R + h*f3_R/(2*gw);
-        // Compute upwind flux-based characteristic variables
-        real w1_U, w2_U;
-        // Wave 1 (v-gw)
-        if (v-gw > 0) {
-          w1_U = w1_L;
-        } else {
-          w1_U = w1_R;
-        }
-        // Wave 2 (v+gw)
-        if (v+gw > 0) {
-          w2_U = w2_L;
-        } else {
-          w2_U = w2_R;
+    static void nc4_put(OutputStream const &st, int v, size_t const *start, size_t const *count, float const *buf) {
+      nc4_check( nc_put_vara_float ( st.ncid , st.varids[v] , start , count , buf ) , "put_vara" );
+    }
+    static void nc4_put(OutputStream const &st, int v, size_t const *start, size_t const *count, double const *buf) {
+      nc4_check( nc_put_vara_double( st.ncid , st.varids[v] , start , count , buf ) , "put_vara" );
+    }
+  #endif
+
+
+
+  // Read the gauges: each entry is either a point gauge at x and y, or a transect of points evenly spaced from
+  // (x[0],y[0]) to (x[1],y[1]), named after the transect with the point's index appended
+  void init_gauges(YAML::Node const &config) {
+    gauges.file   = "gauges.csv";
+    gauges.every  = 1;
+    gauges.step   = 0;
+    gauges.header = false;
+    int buffer = 100;
+    if (config["gauge_file"  ]) { gauges.file  = config["gauge_file"  ].as<std::string>(); }
+    if (config["gauge_every" ]) { gauges.every = config["gauge_every" ].as<int>(); }
+    if (config["gauge_buffer"]) { buffer       = config["gauge_buffer"].as<int>(); }
+    if (gauges.every < 1 || buffer < 1) { endrun("ERROR: gauge_every and gauge_buffer must be at least 1"); }
+    if (! config["gauges"]) { return; }
+
+    for (auto const &node : config["gauges"]) {
+      if ( !node["name"] || !node["x"] ) { endrun("ERROR: Each gauge needs name and x entries"); }
+      std::string name = node["name"].as<std::string>();
+      if (node["points"]) {
+        int n = node["points"].as<int>();
+        std::vector<real> x = node["x"].as<std::vector<real>>();
+        std::vector<real> y = { 0.5_fp*ylen , 0.5_fp*ylen };
+        if (node["y"]) { y = node["y"].as<std::vector<real>>(); }
+        if (n < 2 || x.size() != 2 || y.size() != 2) { endrun("ERROR: A transect needs 2+ points and x / y ends"); }
+        for (int k=0; k < n; k++) {
+          char idx[16];
+          snprintf(idx,16,"_%03d",k);
+          gauges.names.push_back( name + idx );
+          gauges.x.push_back( x[0] + (x[1]-x[0])*k/(n-1) );
+          gauges.y.push_back( y[0] + (y[1]-y[0])*k/(n-1) );
         }
-        fwaves(idH,0,j,i) = w1_U + w2_U;
-        fwaves(idV,0,j,i) = -w1_U*gw/h + w2_U*gw/h;
       } else {
-        fwaves(idU,0,j,i) = 0;
-        fwaves(idU,1,j,i) = 0;
-        fwaves(idH,0,j,i) = 0;
-        fwaves(idV,0,j,i) = 0;
+        gauges.names.push_back( name );
+        gauges.x.push_back( node["x"].as<real>() );
+        gauges.y.push_back( node["y"] ? node["y"].as<real>() : 0.5_fp*ylen );
       }
-    });
+    }
 
-    // Apply the tendencies
-    parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-      if (l == idH || l == idV) {
-        tend(l,j,i) = -( fwaves(l,0,j+1,i) - fwaves(l,0,j,i) ) / dy;
-      } else {
-        tend(l,j,i) += -( fwaves(l,1,j,i) + fwaves(l,0,j+1,i) ) / dy;
+    int ng = gauges.names.size();
+    yakl::Array<int,2,memHost,yakl::styleC> cells_host("gauge_cells",ng,2);
+    for (int g=0; g < ng; g++) {
+      if (gauges.x[g] < 0 || gauges.x[g] > xlen || gauges.y[g] < 0 || gauges.y[g] > ylen) {
+        endrun("ERROR: Gauge " + gauges.names[g] + " lies outside the domain");
       }
-    });
+      cells_host(g,0) = std::min( (int) (gauges.x[g] / dx) , nx_glob-1 );
+      cells_host(g,1) = std::min( (int) (gauges.y[g] / dy) , ny_glob-1 );
+    }
+    gauges.cells    = cells_host.createDeviceCopy();
+    gauges.stencils = real5d("gauge_stencils",buffer,ng,4,ord,ord);
 
+    // The stencil cells this rank owns, which are the only ones it sends when the samples are flushed
+    gauges.owned.clear();
+    for (int g=0; g < ng; g++) {
+      for (int jj=0; jj < ord; jj++) {
+        for (int ii=0; ii < ord; ii++) {
+          long j = gauge_cell( cells_host(g,1)+jj-hs , ny_glob , bc_y == BC_PERIODIC ) - (long) j_beg;
+          long i = gauge_cell( cells_host(g,0)+ii-hs , nx_glob , bc_x == BC_PERIODIC ) - (long) i_beg;
+          if (j >= 0 && j < ny && i >= 0 && i < nx) { gauges.owned.push_back( (g*ord+jj)*ord+ii ); }
+        }
+      }
+    }
+    #ifdef __ENABLE_MPI__
+      if (use_mpi) {
+        int nown = gauges.owned.size();
+        gauges.rank_counts = std::vector<int>( masterproc ? nranks : 0 );
+        MPI_Gather( &nown , 1 , MPI_INT , gauges.rank_counts.data() , 1 , MPI_INT , 0 , MPI_COMM_WORLD );
+        std::vector<int> displs( gauges.rank_counts.size() , 0 );
+        for (int r=1; r < (int) displs.size(); r++) { displs[r] = displs[r-1] + gauges.rank_counts[r-1]; }
+        gauges.rank_owned = std::vector<int>( masterproc ? ng*ord*ord : 0 );
+        MPI_Gatherv( gauges.owned.data() , nown , MPI_INT , gauges.rank_owned.data() , gauges.rank_counts.data() ,
+                     displs.data() , MPI_INT , 0 , MPI_COMM_WORLD );
+      }
+    #endif
   }
 
 
 
-  void output(StateArr const &state, real etime) {
-    YAKL_SCOPE( bath , this->bath );
+  // Take a gauge sample when one is due. Call this after every time step.
+  void sample_gauges(StateArr const &state, real_acc etime) {
+    if (gauges.names.empty()) { return; }
+    gauges.step++;
+    if (gauges.step % gauges.every == 0) {
+      TIMER_START("gauges");
+      sample_gauge_stencils( state , etime );
+      TIMER_STOP("gauges");
+    }
+  }
 
-    #ifdef __ENABLE_MPI__
 
-      std::vector<MPI_Offset> start(2);
-      start[0] = j_beg;
-      start[1] = i_beg;
 
-      yakl::SimplePNetCDF nc;
-      int ulIndex = 0; // Unlimited dimension index to place this data at
+  // Copy the cells this rank owns of each gauge's stencil to the next sample in the buffer, and write the buffer
+  // when it's full. Beyond the domain, stencils wrap around periodic boundaries and otherwise repeat the
+  // nearest cell, and walls reflect the normal velocity to zero there, as the sweeps' BC policies do.
+  void sample_gauge_stencils(StateArr const &state, real_acc etime) {
+    YAKL_SCOPE( bath     , this->bath      );
+    YAKL_SCOPE( nx_glob  , this->nx_glob   );
+    YAKL_SCOPE( ny_glob  , this->ny_glob   );
+    YAKL_SCOPE( nx       , this->nx        );
+    YAKL_SCOPE( ny       , this->ny        );
+    YAKL_SCOPE( cells    , gauges.cells    );
+    YAKL_SCOPE( stencils , gauges.stencils );
+    bool periodic_x = bc_x == BC_PERIODIC;
+    bool periodic_y = bc_y == BC_PERIODIC;
+    bool wall_x     = bc_x == BC_WALL;
+    bool wall_y     = bc_y == BC_WALL;
+    long i_beg = this->i_beg;
+    long j_beg = this->j_beg;
+    int  smp   = gauges.times.size();
+    parallel_for( SimpleBounds<3>(gauges.names.size(),ord,ord) , YAKL_LAMBDA (int g, int jj, int ii) {
+      long jg = cells(g,1)+jj-hs;
+      long ig = cells(g,0)+ii-hs;
+      long js = gauge_cell( jg , ny_glob , periodic_y );
+      long is = gauge_cell( ig , nx_glob , periodic_x );
+      long j  = js - j_beg;
+      long i  = is - i_beg;
+      if (j >= 0 && j < ny && i >= 0 && i < nx) {
+        real h = state(idH,hs+j,hs+i);
+        stencils(smp,g,0,jj,ii) = h;
+        stencils(smp,g,1,jj,ii) = wall_x && is != ig ? 0 : state(idU,hs+j,hs+i);
+        stencils(smp,g,2,jj,ii) = wall_y && js != jg ? 0 : state(idV,hs+j,hs+i);
+        stencils(smp,g,3,jj,ii) = h + bath(hs+j,hs+i);
+      } else {
+        for (int v=0; v < 4; v++) { stencils(smp,g,v,jj,ii) = 0; }
+      }
+    });
+    gauges.times.push_back(etime);
+    if (gauges.times.size() == gauges.stencils.dimension[0]) { flush_gauges(); }
+  }
 
-      // Create or open the file
-      if (etime == 0.) {
-        YAKL_SCOPE( dx , this->dx );
-        YAKL_SCOPE( dy , this->dy );
 
-        nc.create(out_file);
 
-        nc.create_dim("x",nx_glob);
-        nc.create_dim("y",ny_glob);
-        nc.create_unlim_dim("t");
+  // Global cell holding the data of global cell k along a direction of n cells
+  YAKL_INLINE static long gauge_cell(long k, long n, bool periodic) {
+    if (periodic) { return ((k % n) + n) % n; }
+    return k < 0 ? 0 : (k >= n ? n-1 : k);
+  }
 
-        nc.create_var<real>("x",{"x"});
-        nc.create_var<real>("y",{"y"});
-        nc.create_var<real>("t",{"t"});
-        nc.create_var<real>("bath",{"y","x"});
-        nc.create_var<real>("thickness",{"t","y","x"});
-        nc.create_var<real>("u"        ,{"t","y","x"});
-        nc.create_var<real>("v"        ,{"t","y","x"});
-        nc.create_var<real>("surface"  ,{"t","y","x"});
 
-        nc.enddef();
 
-        // Create spatial variables
-        real1d xloc("xloc",nx);
-        parallel_for( nx , YAKL_LAMBDA (int i) { xloc(i) = (i_beg+i+0.5)*dx; });
-        nc.write_all(xloc.createHostCopy(),"x",{(MPI_Offset) i_beg});
+  // Complete the buffered samples' stencils on the master process, and append the thickness, velocities, and
+  // surface height interpolated to each gauge to the file as one CSV row per sample and gauge
+  void flush_gauges() {
+    int nsmp = gauges.times.size();
+    if (gauges.names.empty() || nsmp == 0) { return; }
+    TIMER_START("gauge_flush");
+    int ng = gauges.names.size();
+    realHost5d host = gauges.stencils.createHostCopy();
+    #ifdef __ENABLE_MPI__
+      if (use_mpi) {
+        // Every rank sends the values of only the stencil cells it owns, and the master process puts them in place
+        int constexpr nsten = ord*ord;
+        int nown = gauges.owned.size();
+        std::vector<real> send( nsmp*nown*4 );
+        for (int smp=0; smp < nsmp; smp++) {
+          for (int k=0; k < nown; k++) {
+            int c = gauges.owned[k];
+            for (int v=0; v < 4; v++) { send[(smp*nown+k)*4+v] = host.data()[((smp*ng+c/nsten)*4+v)*nsten+c%nsten]; }
+          }
+        }
+        std::vector<int> counts( gauges.rank_counts.size() );
+        std::vector<int> displs( gauges.rank_counts.size() , 0 );
+        for (int r=0; r < (int) counts.size(); r++) {
+          counts[r] = gauges.rank_counts[r]*nsmp*4;
+          if (r > 0) { displs[r] = displs[r-1] + counts[r-1]; }
+        }
+        std::vector<real> recv( masterproc ? nsmp*ng*nsten*4 : 0 );
+        MPI_Gatherv( send.data() , (int) send.size() , mpi_dtype , recv.data() , counts.data() , displs.data() ,
+                     mpi_dtype , 0 , MPI_COMM_WORLD );
+        int off = 0;
+        for (int r=0; r < (int) counts.size(); r++) {
+          int nr = gauges.rank_counts[r];
+          for (int smp=0; smp < nsmp; smp++) {
+            for (int k=0; k < nr; k++) {
+              int c = gauges.rank_owned[off+k];
+              for (int v=0; v < 4; v++) {
+                host.data()[((smp*ng+c/nsten)*4+v)*nsten+c%nsten] = recv[displs[r]+(smp*nr+k)*4+v];
+              }
+            }
+          }
+          off += nr;
+        }
+      }
+    #endif
+    if (masterproc) {
+      std::ofstream out( gauges.file , gauges.header ? std::ios::app : std::ios::trunc );
+      if (! out) { endrun("ERROR: Couldn't write the gauge file " + gauges.file); }
+      int digits     = std::numeric_limits<real    >::max_digits10;
+      int digits_acc = std::numeric_limits<real_acc>::max_digits10;
+      out << std::setprecision(digits);
+      if (! gauges.header) {
+        for (int g=0; g < ng; g++) {
+          out << "# gauge " << gauges.names[g] << " x " << gauges.x[g] << " y " << gauges.y[g] << "\n";
+        }
+        out << "t,gauge,thickness,u,v,surface\n";
+      }
+      for (int smp=0; smp < nsmp; smp++) {
+        for (int g=0; g < ng; g++) {
+          // Position of the gauge within its cell, from -1/2 to 1/2
+          real xi_x = gauges.x[g] / dx - std::min( (int) (gauges.x[g] / dx) , nx_glob-1 ) - 0.5_fp;
+          real xi_y = gauges.y[g] / dy - std::min( (int) (gauges.y[g] / dy) , ny_glob-1 ) - 0.5_fp;
+          out << std::setprecision(digits_acc) << gauges.times[smp] << std::setprecision(digits) << ","
+              << gauges.names[g];
+          for (int v=0; v < 4; v++) {
+            real val = gauge_value( host , smp , g , v , xi_x , xi_y );
+            if (v == 0) { val = std::max( val , 0._fp ); }
+            out << "," << val;
+          }
+          out << "\n";
+        }
+      }
+    }
+    gauges.header = true;
+    gauges.times.clear();
+    TIMER_STOP("gauge_flush");
+  }
 
-        real1d yloc("yloc",ny);
-        parallel_for( ny , YAKL_LAMBDA (int j) { yloc(j) = (j_beg+j+0.5)*dy; });
-        nc.write_all(yloc.createHostCopy(),"y",{(MPI_Offset) j_beg});
 
-        // Write bathymetry data
-        real2d data("data",ny,nx);
-        parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = bath(hs+j,hs+i); });
-        nc.write_all(data.createHostCopy(),"bath",start);
 
-        // Elapsed time
-        nc.begin_indep_data();
-        if (masterproc) {
-          nc.write1(0._fp,"t",0,"t");
-        }
-        nc.end_indep_data();
+  // Value of variable v of a gauge's stencil at (xi_x,xi_y) within its center cell, reconstructed in x along
+  // each row of the stencil and then in y across the rows, the way the model reconstructs its GLL values
+  real gauge_value(realHost5d const &stencils, int smp, int g, int v, real xi_x, real xi_y) const {
+    SArray<real,1,ord> col;
+    for (int jj=0; jj < ord; jj++) {
+      SArray<real,1,ord> row;
+      for (int ii=0; ii < ord; ii++) { row(ii) = stencils(smp,g,v,jj,ii); }
+      col(jj) = reconstruct_point( row , xi_x );
+    }
+    return sim1d ? col(hs) : reconstruct_point( col , xi_y );
+  }
 
-      } else {
 
-        nc.open(out_file);
 
-        // Write the elapsed time
-        ulIndex = nc.get_dim_size("t");
+  // Value at xi, from -1/2 to 1/2, of the WENO polynomial reconstructed from a stencil of cell averages
+  real reconstruct_point(SArray<real,1,ord> const &stencil, real xi) const {
+    SArray<real,1,ord> coefs;
+    #if (ORD > 1)
+      weno::compute_weno_coefs( weno_recon , stencil , coefs , idl , sigma );
+    #else
+      coefs(0) = stencil(0);
+    #endif
+    real_acc val = 0;
+    real_acc pow = 1;
+    for (int s=0; s < ord; s++) {
+      val += coefs(s) * pow;
+      pow *= xi;
+    }
+    return val;
+  }
 
-        nc.begin_indep_data();
-        if (masterproc) {
-          nc.write1(etime,"t",ulIndex,"t");
-        }
-        nc.end_indep_data();
-      }
 
-      // Write the data
-      real2d data("data",ny,nx);
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idH,hs+j,hs+i); });
-      nc.write1_all(data.createHostCopy(),"thickness",ulIndex,start,"t");
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idU,hs+j,hs+i); });
-      nc.write1_all(data.createHostCopy(),"u",ulIndex,start,"t");
+  // Drop the samples after etime from the gauge file of the run that wrote the checkpoint, so the restarted run
+  // continues it without duplicates
+  void restart_gauges(real_acc etime, int nstep) {
+    gauges.step   = nstep;
+    gauges.header = true;
+    if (masterproc) { gauges.header = truncate_log( gauges.file , etime , true ); }
+  }
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idV,hs+j,hs+i); });
-      nc.write1_all(data.createHostCopy(),"v",ulIndex,start,"t");
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idH,hs+j,hs+i) +
-                                                                                      bath(hs+j,hs+i); });
-      nc.write1_all(data.createHostCopy(),"surface",ulIndex,start,"t");
 
-      // Close the file
-      nc.close();
+  // Drop the rows of a CSV log after etime, or from etime on unless keep_etime, keeping its comment and header
+  // lines. Returns whether the file exists.
+  static bool truncate_log(std::string file, real_acc etime, bool keep_etime) {
+    std::ifstream in( file );
+    if (! in) { return false; }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in,line)) {
+      bool row = ! line.empty() && line[0] != '#' && line.compare(0,2,"t,") != 0;
+      if (! row || std::stod(line) < etime || (keep_etime && std::stod(line) == etime)) { lines.push_back(line); }
+    }
+    in.close();
+    std::ofstream out( file , std::ios::trunc );
+    for (auto const &l : lines) { out << l << "\n"; }
+    return true;
+  }
 
-    #else
 
-      yakl::SimpleNetCDF nc;
-      int ulIndex = 0; // Unlimited dimension index to place this data at
 
-      // Create or open the file
-      if (etime == 0.) {
-        YAKL_SCOPE( dx , this->dx );
-        YAKL_SCOPE( dy , this->dy );
+  // Finish the outputs still queued on the background writer, and write the gauges' buffered samples and the
+  // diagnostics rows logged so far, e.g., before a checkpoint, so the files hold everything up to it
+  void flush_logs() {
+    if (writer) { writer->wait(); }
+    flush_gauges();
+    if (diag_log) { diag_log->flush(); }
+  }
 
-        nc.create(out_file);
 
-        // Create spatial variables
-        real1d xloc("xloc",nx);
-        parallel_for( nx , YAKL_LAMBDA (int i) { xloc(i) = (i+0.5)*dx; });
-        nc.write(xloc.createHostCopy(),"x",{"x"});
 
-        real1d yloc("yloc",ny);
-        parallel_for( ny , YAKL_LAMBDA (int j) { yloc(j) = (j+0.5)*dy; });
-        nc.write(yloc.createHostCopy(),"y",{"y"});
+  // Start the envelope statistics from the initial state
+  void init_envelope(StateArr const &state) {
+    YAKL_SCOPE( bath      , this->bath               );
+    YAKL_SCOPE( surf_max  , this->envelope.surf_max  );
+    YAKL_SCOPE( speed_max , this->envelope.speed_max );
+    YAKL_SCOPE( arrival   , this->envelope.arrival   );
+    YAKL_SCOPE( stats     , this->envelope.stats     );
+    bool moments = envelope.moments;
+    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+      surf_max (j,i) = bath(hs+j,hs+i);
+      speed_max(j,i) = 0;
+      arrival  (j,i) = -1;
+      if (moments) { for (int q=0; q < 4; q++) { stats(q,j,i) = 0; } }
+    });
+    envelope.etime = 0;
+    EnvelopeUpdate update = envelope_update( 0 );
+    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+      update( state , j , i );
+    });
+  }
 
-        // Write bathymetry data
-        real2d data("data",ny,nx);
-        parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = bath(hs+j,hs+i); });
-        nc.write(data.createHostCopy(),"bath",{"y","x"});
 
-        // Elapsed time
-        nc.write1(0._fp,"t",0,"t");
-      } else {
-        nc.open(out_file,yakl::NETCDF_MODE_WRITE);
 
-        // Write the elapsed time
-        ulIndex = nc.getDimSize("t");
-        nc.write1(etime,"t",ulIndex,"t");
-      }
-      // Write the data
-      real2d data("data",ny,nx);
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idH,hs+j,hs+i); });
-      nc.write1(data.createHostCopy(),"thickness",{"y","x"},ulIndex,"t");
+  // The update of the envelope statistics by a time step of dt, whose end becomes their time. A temporal
+  // operator takes it once per time step and applies it to every cell in its last stage.
+  EnvelopeUpdate envelope_update(real dt) {
+    EnvelopeUpdate update;
+    update.active = ! envelope.file.empty();
+    if (! update.active) { return update; }
+    envelope.etime  += dt;
+    update.moments   = envelope.moments;
+    update.threshold = envelope.threshold;
+    update.wet_tol   = std::max( dry_tol , (real) eps );
+    update.etime     = envelope.etime;
+    update.dt        = dt;
+    update.frac      = envelope.etime > 0 ? dt / envelope.etime : 1;
+    update.bath      = bath;
+    update.surf_max  = envelope.surf_max;
+    update.speed_max = envelope.speed_max;
+    update.arrival   = envelope.arrival;
+    update.stats     = envelope.stats;
+    return update;
+  }
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idU,hs+j,hs+i); });
-      nc.write1(data.createHostCopy(),"u",{"y","x"},ulIndex,"t");
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idV,hs+j,hs+i); });
-      nc.write1(data.createHostCopy(),"v",{"y","x"},ulIndex,"t");
 
-      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = state(idH,hs+j,hs+i) +
-                                                                                      bath(hs+j,hs+i); });
-      nc.write1(data.createHostCopy(),"surface"  ,{"y","x"},ulIndex,"t");
+  // Write the envelope statistics to their own file, the variances divided by the time they were accumulated over
+  void write_envelope() {
+    YAKL_SCOPE( bath      , this->bath               );
+    YAKL_SCOPE( surf_max  , this->envelope.surf_max  );
+    YAKL_SCOPE( speed_max , this->envelope.speed_max );
+    YAKL_SCOPE( arrival   , this->envelope.arrival   );
+    YAKL_SCOPE( stats     , this->envelope.stats     );
+    bool     moments = envelope.moments;
+    real_acc etime   = envelope.etime;
+    std::vector<std::string> names = { "surface_max" , "speed_max" , "arrival_time" };
+    if (moments) {
+      for (auto const &name : { "surface_mean" , "surface_var" , "speed_mean" , "speed_var" }) { names.push_back(name); }
+    }
+    int nf = names.size();
 
-      // Close the file
-      nc.close();
+    // The fields, followed by the bathymetry
+    real3d fields("env_fields",nf+1,ny,nx);
+    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+      fields(0,j,i) = surf_max (j,i);
+      fields(1,j,i) = speed_max(j,i);
+      fields(2,j,i) = arrival  (j,i);
+      if (moments) {
+        fields(3,j,i) = stats(0,j,i);
+        fields(4,j,i) = etime > 0 ? stats(1,j,i) / etime : 0;
+        fields(5,j,i) = stats(2,j,i);
+        fields(6,j,i) = etime > 0 ? stats(3,j,i) / etime : 0;
+      }
+      fields(nf,j,i) = bath(hs+j,hs+i);
+    });
+    realHost3d fields_host = fields.createHostCopy();
+
+    // Coordinates of this rank's cells
+    realHost1d xloc("xloc",nx);
+    realHost1d yloc("yloc",ny);
+    for (int i=0; i < nx; i++) { xloc(i) = (i_beg + i + 0.5)*dx; }
+    for (int j=0; j < ny; j++) { yloc(j) = (j_beg + j + 0.5)*dy; }
 
+    #ifdef __ENABLE_MPI__
+      nc_type type = std::is_same<real,float>::value ? NC_FLOAT : NC_DOUBLE;
+      int ncid, dim_x, dim_y;
+      std::vector<int> varids(3+nf);
+      ncmpi_check( ncmpi_create( MPI_COMM_WORLD , envelope.file.c_str() , NC_CLOBBER | NC_64BIT_DATA , MPI_INFO_NULL ,
+                                 &ncid ) , "create" );
+      ncmpi_check( ncmpi_def_dim( ncid , "x" , nx_glob , &dim_x ) , "def_dim" );
+      ncmpi_check( ncmpi_def_dim( ncid , "y" , ny_glob , &dim_y ) , "def_dim" );
+      int dims_yx[2] = { dim_y , dim_x };
+      ncmpi_check( ncmpi_def_var( ncid , "x"    , type , 1 , &dim_x  , &varids[0] ) , "def_var" );
+      ncmpi_check( ncmpi_def_var( ncid , "y"    , type , 1 , &dim_y  , &varids[1] ) , "def_var" );
+      ncmpi_check( ncmpi_def_var( ncid , "bath" , type , 2 , dims_yx , &varids[2] ) , "def_var" );
+      for (int k=0; k < nf; k++) {
+        ncmpi_check( ncmpi_def_var( ncid , names[k].c_str() , type , 2 , dims_yx , &varids[3+k] ) , "def_var" );
+      }
+      ncmpi_check( ncmpi_enddef( ncid ) , "enddef" );
+      MPI_Offset start[2] = { (MPI_Offset) j_beg , (MPI_Offset) i_beg };
+      MPI_Offset count[2] = { (MPI_Offset) ny    , (MPI_Offset) nx    };
+      ncmpi_check( ncmpi_put_vara_all( ncid , varids[0] , &start[1] , &count[1] , xloc.data() , nx , mpi_dtype ) ,
+                   "put_vara_all" );
+      ncmpi_check( ncmpi_put_vara_all( ncid , varids[1] , &start[0] , &count[0] , yloc.data() , ny , mpi_dtype ) ,
+                   "put_vara_all" );
+      for (int k=0; k <= nf; k++) {
+        int v = k == nf ? 2 : 3+k;
+        ncmpi_check( ncmpi_put_vara_all( ncid , varids[v] , start , count , fields_host.data()+k*ny*nx , ny*nx ,
+                                         mpi_dtype ) , "put_vara_all" );
+      }
+      ncmpi_check( ncmpi_close( ncid ) , "close" );
+    #else
+      yakl::SimpleNetCDF nc;
+      nc.create(envelope.file);
+      nc.write(xloc,"x",{"x"});
+      nc.write(yloc,"y",{"y"});
+      realHost2d bath2d("bath",fields_host.data()+nf*ny*nx,ny,nx);
+      nc.write(bath2d,"bath",{"y","x"});
+      for (int k=0; k < nf; k++) {
+        realHost2d data("data",fields_host.data()+k*ny*nx,ny,nx);
+        nc.write(data,names[k],{"y","x"});
+      }
+      nc.close();
     #endif
   }
 
 
 
   void finalize(StateArr const &state) {
-    YAKL_SCOPE( bath       , this->bath       );
-    YAKL_SCOPE( surf_level , this->surf_level );
-    
-    real2d mass("mass",ny,nx);
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
-      real h = state(idH,hs+j,hs+i);
-      mass(j,i) = h;
-    });
-    real mass_final_perproc = yakl::intrinsics::sum( mass );
-    real mass_final = mass_final_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &mass_final_perproc , &mass_final , 1 , mpi_dtype ,
-                       MPI_SUM , MPI_COMM_WORLD );
-      #endif
+    flush_gauges();
+    if (writer) { writer->wait(); }
+    for (int s=0; s < (int) streams.size(); s++) {
+      if (streams[s].ncid >= 0) {
+        if (out_netcdf4) {
+          #ifdef __ENABLE_NETCDF4__
+            nc4_check( nc_close(streams[s].ncid) , "close" );
+          #endif
+        } else {
+          #ifdef __ENABLE_MPI__
+            ncmpi_check( ncmpi_close(streams[s].ncid) , "close" );
+          #endif
+        }
+        streams[s].ncid = -1;
+      }
     }
-    if (masterproc) std::cout << "Relative mass change: " << (mass_final-mass_init) / mass_init << "\n";
+    #ifdef __ENABLE_MPI__
+      if (io_comm != MPI_COMM_WORLD) { MPI_Comm_free( &io_comm );  io_comm = MPI_COMM_WORLD; }
+    #endif
+    if (! envelope.file.empty()) { write_envelope(); }
+
+    DiagArr diag = reduce_diagnostics( state );
+    if (diag_etime >= 0) { write_diagnostics( diag ); }
+    if (diag_log) { diag_log->flush(); }
+
+    if (masterproc) {
+      real_acc ncells = (real_acc) nx_glob * ny_glob;
+      std::cout << "Relative mass change: " << (diag(diag_mass)-mass_init) / mass_init << "\n";
+      for (int tr=0; tr < num_tracers; tr++) {
+        std::cout << "Relative mass change of tracer " << tr+1 << ": "
+                  << (diag(diag_tracer+tr)-tracer_mass_init[tr]) / tracer_mass_init[tr] << "\n";
+      }
+      if (surf_level > 0) {
+        std::cout << "Avg abs(surf-surf_level): " << diag(diag_surf_sum) / ncells << "\n";
+        std::cout << "Max abs(surf-surf_level): " << diag(diag_surf_max) << "\n";
+      }
+      std::cout << "Avg abs(uvel): " << diag(diag_u_sum) / ncells << "\n";
+      if (surf_level > 0) { std::cout << "Max abs(uvel): " << diag(diag_u_max) << "\n"; }
+      std::cout << "Avg abs(vvel): " << diag(diag_v_sum) / ncells << "\n";
+      if (surf_level > 0) { std::cout << "Max abs(vvel): " << diag(diag_v_max) << "\n"; }
+    }
+  }
 
 
-    real2d data("data",ny,nx);
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = abs(state(idH,hs+j,hs+i)+
-                                                                                  bath(hs+j,hs+i)-surf_level); });
-    real data_mean_perproc = yakl::intrinsics::sum(data)/nx/ny;
-    real data_mean = data_mean_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_mean_perproc , &data_mean , 1 , mpi_dtype ,
-                       MPI_SUM , MPI_COMM_WORLD );
-        data_mean /= nranks;
-      #endif
-    }
-    if (surf_level > 0) {
-      if (masterproc) std::cout << "Avg abs(surf-surf_level): " << data_mean << "\n";
-    }
-    real data_max_perproc = yakl::intrinsics::maxval(data);
-    real data_max = data_max_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_max_perproc , &data_max , 1 , mpi_dtype ,
-                       MPI_MAX , MPI_COMM_WORLD );
-      #endif
+
+
+  // Map cell index k along a sweep of n cells, which may lie beyond either end, to the cell that holds its
+  // data. bnd_lo / bnd_hi tell whether each end is a physical boundary; otherwise the halo is read as is,
+  // as it is for nested boundaries.
+  template <class BC>
+  YAKL_INLINE static int bc_index( int k , int n , bool bnd_lo , bool bnd_hi ) {
+    if (BC::nested) { return k; }
+    if (k <  0 && bnd_lo) { return BC::periodic ? k+n : 0  ; }
+    if (k >= n && bnd_hi) { return BC::periodic ? k-n : n-1; }
+    return k;
+  }
+
+
+
+  // Edge limits of a cell held constant across its width, which is how the coarse grid's boundary state in the
+  // halo of a nested boundary enters the Riemann split
+  template <int DIR>
+  YAKL_INLINE static void constant_cell_limits( StateArr const &state , real2d const &bath , int j , int i ,
+                                                SArray<real,1,num_edge> &lim ) {
+    int constexpr idN = DIR == DIR_X ? idU : idV;
+    for (int l=0; l < idTr; l++) { lim(l) = state(l,hs+j,hs+i); }
+    for (int tr=0; tr < num_tracers; tr++) {
+      lim(idTr+tr) = lim(idH) > eps ? state(idTr+tr,hs+j,hs+i) / lim(idH) : 0;
     }
-    if (surf_level > 0) {
-      if (masterproc) std::cout << "Max abs(surf-surf_level): " << data_max << "\n";
+    lim(idSurf) = lim(idH) + bath(hs+j,hs+i);
+    lim(idHN)   = lim(idH)*lim(idN);
+    lim(idNN)   = lim(idN)*lim(idN);
+  }
+
+
+
+  // Split the flux difference at one interface into characteristic waves. Inputs are the left and right
+  // limits of h, the normal (n) and transverse (t) velocities, the surface height, h*n, and n*n. Outputs
+  // are the upwind fluxes of h and n and the left-going and right-going waves of t.
+  YAKL_INLINE static void split_flux_difference( real h_L , real n_L , real t_L , real hs_L , real hn_L , real nn_L ,
+                                                 real h_R , real n_R , real t_R , real hs_R , real hn_R , real nn_R ,
+                                                 real grav , bool sim1d ,
+                                                 real &fw_h , real &fw_n , real &fw_t_L , real &fw_t_R ) {
+    // Compute interface linearly averaged values for the state
+    real h  = 0.5_fp * (h_L + h_R);
+    real un = 0.5_fp * (n_L + n_R);
+    real gw = sqrt(grav*h);
+    if (gw > 0) {
+      // Compute flux difference splitting for the transverse velocity
+      fw_t_L = 0;
+      fw_t_R = 0;
+      if (! sim1d) {
+        if (un < 0) {
+          fw_t_L += un*(t_R - t_L);
+        } else {
+          fw_t_R += un*(t_R - t_L);
+        }
+      }
+
+      // Compute left and right flux for h and the normal velocity
+      real f1_L = hn_L;
+      real f1_R = hn_R;
+      real f2_L = nn_L*0.5_fp + grav*hs_L;
+      real f2_R = nn_R*0.5_fp + grav*hs_R;
+      // Compute left and right flux-based characteristic variables
+      real w1_L = 0.5_fp * f1_L - h*f2_L/(2*gw);
+      real w1_R = 0.5_fp * f1_R - h*f2_R/(2*gw);
+      real w2_L = 0.5_fp * f1_L + h*f2_L/(2*gw);
+      real w2_R = 0.5_fp * f1_R + h*f2_R/(2*gw);
+      // Compute upwind flux-based characteristic variables
+      real w1_U, w2_U;
+      // Wave 1 (un-gw)
+      if (un-gw > 0) {
+        w1_U = w1_L;
+      } else {
+        w1_U = w1_R;
+      }
+      // Wave 2 (un+gw)
+      if (un+gw > 0) {
+        w2_U = w2_L;
+      } else {
+        w2_U = w2_R;
+      }
+      fw_h = w1_U + w2_U;
+      fw_n = -w1_U*gw/h + w2_U*gw/h;
+    } else {
+      fw_t_L = 0;
+      fw_t_R = 0;
+      fw_h   = 0;
+      fw_n   = 0;
     }
+  }
 
 
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = abs(state(idU,hs+j,hs+i)); });
-    data_mean_perproc = yakl::intrinsics::sum(data)/nx/ny;
-    data_mean = data_mean_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_mean_perproc , &data_mean , 1 , mpi_dtype ,
-                       MPI_SUM , MPI_COMM_WORLD );
-        data_mean /= nranks;
-      #endif
+
+  // Reconstruct one cell (j,i) for a sweep in direction DIR, compute its ADER time derivatives, and time average
+  // when requested. Returns the limits of h, u, v, the surface height, h*n, and n*n (indexed as the edges array)
+  // at the cell's lower and upper edges along the sweep, along with the "centered" transverse velocity tendency.
+  template <int DIR, class BC>
+  YAKL_INLINE static void reconstruct_cell_limits( StateArr const &state , real2d const &bath , real3d const &bath_gll_n ,
+                                                   int j , int i , int n , bool bnd_lo , bool bnd_hi , real dn ,
+                                                   real dt , real grav , bool sim1d ,
+                                                   SArray<real,2,ord,ngll> const &s2g ,
+                                                   SArray<real,2,ord,ngll> const &s2d2g ,
+                                                   SArray<real,2,ord,ngll> const &c2g ,
+                                                   SArray<real,2,ord,ngll> const &c2d2g ,
+                                                   SArray<real,2,ngll,ngll> const &deriv_matrix ,
+                                                   SArray<real,1,ngll> const &gllWts_ngll ,
+                                                   weno::wt_type const &idl , real sigma ,
+                                                   SArray<real,3,ord,ord,ord> const &weno_recon ,
+                                                   SArray<real,1,num_edge> &lim_lo , SArray<real,1,num_edge> &lim_hi ,
+                                                   real &tend_t ) {
+    int constexpr di  = DIR == DIR_X ? 1 : 0;
+    int constexpr dj  = DIR == DIR_Y ? 1 : 0;
+    int constexpr idN = DIR == DIR_X ? idU : idV;
+    int constexpr idT = DIR == DIR_X ? idV : idU;
+    int k = DIR == DIR_X ? i : j;  // Cell index along the sweep
+
+    // Load the stencil along the sweep. Cells beyond a physical boundary are mapped by the BC policy, and
+    // walls reflect the normal velocity to zero there
+    SArray<real,1,ord> h_sten;
+    SArray<real,1,ord> n_sten;
+    SArray<real,1,ord> t_sten;
+    SArray<real,1,ord> b_sten;
+    SArray<real,2,ord,num_tracers_arr> c_sten;  // Tracer concentrations, with the tracer innermost
+    for (int s=0; s<ord; s++) {
+      int kk = k+s-hs;
+      int ks = bc_index<BC>( kk , n , bnd_lo , bnd_hi );
+      int js = hs + dj*ks + di*j;
+      int is = hs + di*ks + dj*i;
+      h_sten(s) = state(idH,js,is);
+      n_sten(s) = BC::reflect && ks != kk ? 0 : state(idN,js,is);
+      t_sten(s) = state(idT,js,is);
+      b_sten(s) = bath (    js,is);
+      for (int tr=0; tr < num_tracers; tr++) {
+        c_sten(s,tr) = h_sten(s) > eps ? state(idTr+tr,js,is) / h_sten(s) : 0;
+      }
     }
-    if (masterproc) std::cout << "Avg abs(uvel): " << data_mean << "\n";
-    data_max_perproc = yakl::intrinsics::maxval(data);
-    data_max = data_max_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_max_perproc , &data_max , 1 , mpi_dtype ,
-                       MPI_MAX , MPI_COMM_WORLD );
-      #endif
+
+    SArray<real,1,ord> stencil;
+
+    // Reconstruct h and the normal velocity
+    SArray<real,2,nAder,ngll> h_DTs;
+    SArray<real,2,nAder,ngll> n_DTs;
+    SArray<real,2,nAder,ngll> t_DTs;
+    SArray<real,2,nAder,ngll> dtdn_DTs;
+    SArray<real,2,nAder,ngll> surf_DTs;
+    {
+      real h  = state(idH,hs+j,hs+i);
+      real gw = sqrt(grav*h);
+
+      // Reconstruct first characteristic variable stored in h
+      for (int s=0; s<ord; s++) { stencil(s) = 0.5_fp * (h_sten(s)+b_sten(s)) - h/(2*gw)*n_sten(s); }
+      reconstruct_gll_values( stencil , h_DTs , s2g , c2g , idl , sigma , weno_recon );
+
+      // Reconstruct second characteristic variable stored in n
+      for (int s=0; s<ord; s++) { stencil(s) = 0.5_fp * (h_sten(s)+b_sten(s)) + h/(2*gw)*n_sten(s); }
+      reconstruct_gll_values( stencil , n_DTs , s2g , c2g , idl , sigma , weno_recon );
+
+      for (int ii=0; ii < ngll; ii++) {
+        real w1 = h_DTs(0,ii);
+        real w2 = n_DTs(0,ii);
+        surf_DTs(0,ii) =       w1 +      w2;
+        n_DTs   (0,ii) = -gw/h*w1 + gw/h*w2;
+      }
     }
-    if (surf_level > 0) {
-      if (masterproc) std::cout << "Max abs(uvel): " << data_max << "\n";
+
+    for (int ii=0; ii<ngll; ii++) { h_DTs(0,ii) = surf_DTs(0,ii) - bath_gll_n(j,i,ii); }
+
+    // Reconstruct the transverse velocity and its derivative along the sweep
+    reconstruct_gll_values_and_derivs( t_sten , t_DTs , dtdn_DTs, dn , s2g , s2d2g ,
+                                       c2g , c2d2g , idl , sigma , weno_recon );
+
+    // Reconstruct the tracer concentrations and their derivatives along the sweep, all tracers at once with the
+    // tracer innermost. Like the transverse velocity, they're only carried by the normal velocity, so they reuse
+    // its time derivatives below
+    SArray<real,3,nAder,ngll,num_tracers_arr> c_DTs;
+    SArray<real,3,nAder,ngll,num_tracers_arr> dcdn_DTs;
+    SArray<real,3,nAder,ngll,num_tracers_arr> n_dcdn_DTs;
+    if (num_tracers > 0) {
+      reconstruct_gll_values_and_derivs_batch( c_sten , c_DTs , dcdn_DTs , dn , c2g , c2d2g , idl , sigma ,
+                                               weno_recon );
     }
 
+    // Walls only apply at this rank's first / last cell when it lies on a physical boundary
+    bool wall_lo = BC::reflect && bnd_lo && k == 0;
+    bool wall_hi = BC::reflect && bnd_hi && k == n-1;
 
-    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) { data(j,i) = abs(state(idV,hs+j,hs+i)); });
-    data_mean_perproc = yakl::intrinsics::sum(data)/nx/ny;
-    data_mean = data_mean_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_mean_perproc , &data_mean , 1 , mpi_dtype ,
-                       MPI_SUM , MPI_COMM_WORLD );
-        data_mean /= nranks;
-      #endif
+    if (wall_hi) n_DTs(0,ngll-1) = 0;
+    if (wall_lo) n_DTs(0,0     ) = 0;
+
+    SArray<real,2,nAder,ngll> h_n_DTs;
+    SArray<real,2,nAder,ngll> n_n_DTs;
+    SArray<real,2,nAder,ngll> n_dtdn_DTs;
+    for (int ii=0; ii<ngll; ii++) {
+      h_n_DTs (0,ii) = h_DTs(0,ii) * n_DTs (0,ii);
+      n_n_DTs (0,ii) = n_DTs(0,ii) * n_DTs (0,ii);
+      n_dtdn_DTs(0,ii) = n_DTs(0,ii) * dtdn_DTs(0,ii);
+      for (int tr=0; tr < num_tracers; tr++) { n_dcdn_DTs(0,ii,tr) = n_DTs(0,ii) * dcdn_DTs(0,ii,tr); }
     }
-    if (masterproc) std::cout << "Avg abs(vvel): " << data_mean << "\n";
-    data_max_perproc = yakl::intrinsics::maxval(data);
-    data_max = data_max_perproc;
-    if (use_mpi) {
-      #ifdef __ENABLE_MPI__
-        MPI_Allreduce( &data_max_perproc , &data_max , 1 , mpi_dtype ,
-                       MPI_MAX , MPI_COMM_WORLD );
-      #endif
+
+    if (nAder > 1) {
+      for (int kt=0; kt < nAder-1; kt++) {
+        // Compute state at kt+1
+        for (int ii=0; ii<ngll; ii++) {
+          // Compute d_dn(h*n) and d_dn(n*n/2+grav*(h+hb))
+          real_acc dh_n_dn  = 0;
+          real_acc dntend_dn  = 0;
+          for (int s=0; s<ngll; s++) {
+            dh_n_dn   += deriv_matrix(s,ii) * h_n_DTs (kt,s);
+            dntend_dn += deriv_matrix(s,ii) * ( n_n_DTs(kt,s)/2 + grav*surf_DTs(kt,s) );
+          }
+          dh_n_dn   /= dn;
+          dntend_dn /= dn;
+          h_DTs(kt+1,ii) = -( dh_n_dn         ) / (kt+1);
+          n_DTs(kt+1,ii) = -( dntend_dn       ) / (kt+1);
+          if (sim1d) {
+            t_DTs(kt+1,ii) = 0;
+          } else {
+            t_DTs(kt+1,ii) = -( n_dtdn_DTs(kt,ii) ) / (kt+1);
+          }
+          for (int tr=0; tr < num_tracers; tr++) { c_DTs(kt+1,ii,tr) = -( n_dcdn_DTs(kt,ii,tr) ) / (kt+1); }
+        }
+        if (wall_hi) n_DTs(kt+1,ngll-1) = 0;
+        if (wall_lo) n_DTs(kt+1,0     ) = 0;
+        // Compute h*n, n*n, h+b, and n_dtdn_DTs at kt+1
+        for (int ii=0; ii<ngll; ii++) {
+          // bathymetry has no time derivatives (no earthquakes...)
+          surf_DTs(kt+1,ii) = h_DTs(kt+1,ii);
+          // Differentiate t at kt+1 to get dtdn at kt+1
+          real_acc dtdn = 0;
+          for (int s=0; s<ngll; s++) {
+            dtdn += deriv_matrix(s,ii) * t_DTs(kt+1,s);
+          }
+          dtdn /= dn;
+          dtdn_DTs(kt+1,ii) = dtdn;
+          // Compute h*n, n*n, and n*dtdn
+          real_acc h_n    = 0;
+          real_acc n_n    = 0;
+          real_acc n_dtdn = 0;
+          for (int rt=0; rt <= kt+1; rt++) {
+            h_n    += h_DTs(rt,ii) * n_DTs (kt+1-rt,ii);
+            n_n    += n_DTs(rt,ii) * n_DTs (kt+1-rt,ii);
+            n_dtdn += n_DTs(rt,ii) * dtdn_DTs(kt+1-rt,ii);
+          }
+          h_n_DTs (kt+1,ii) = h_n;
+          n_n_DTs (kt+1,ii) = n_n;
+          n_dtdn_DTs(kt+1,ii) = n_dtdn;
+          // Same for the tracer concentrations, with the tracer innermost
+          SArray<real_acc,1,num_tracers_arr> dcdn;
+          SArray<real_acc,1,num_tracers_arr> n_dcdn;
+          for (int tr=0; tr < num_tracers; tr++) { dcdn(tr) = 0;  n_dcdn(tr) = 0; }
+          for (int s=0; s<ngll; s++) {
+            for (int tr=0; tr < num_tracers; tr++) { dcdn(tr) += deriv_matrix(s,ii) * c_DTs(kt+1,s,tr); }
+          }
+          for (int tr=0; tr < num_tracers; tr++) { dcdn_DTs(kt+1,ii,tr) = dcdn(tr) / dn; }
+          for (int rt=0; rt <= kt+1; rt++) {
+            for (int tr=0; tr < num_tracers; tr++) { n_dcdn(tr) += n_DTs(rt,ii) * dcdn_DTs(kt+1-rt,ii,tr); }
+          }
+          for (int tr=0; tr < num_tracers; tr++) { n_dcdn_DTs(kt+1,ii,tr) = n_dcdn(tr); }
+        }
+        if (wall_hi) {
+          h_n_DTs (kt+1,ngll-1) = 0;
+          n_n_DTs (kt+1,ngll-1) = 0;
+          n_dtdn_DTs(kt+1,ngll-1) = 0;
+          for (int tr=0; tr < num_tracers; tr++) { n_dcdn_DTs(kt+1,ngll-1,tr) = 0; }
+        }
+        if (wall_lo) {
+          h_n_DTs (kt+1,0     ) = 0;
+          n_n_DTs (kt+1,0     ) = 0;
+          n_dtdn_DTs(kt+1,0     ) = 0;
+          for (int tr=0; tr < num_tracers; tr++) { n_dcdn_DTs(kt+1,0     ,tr) = 0; }
+        }
+      }
     }
-    if (surf_level > 0) {
-      if (masterproc) std::cout << "Max abs(vvel): " << data_max << "\n";
+
+    if (time_avg) {
+      // Compute time averages
+      for (int ii=0; ii<ngll; ii++) {
+        real_acc dtmult = 1;
+        real_acc h_tavg    = 0;
+        real_acc n_tavg    = 0;
+        real_acc t_tavg    = 0;
+        real_acc surf_tavg = 0;
+        real_acc n_dtdn_tavg = 0;
+        real_acc h_n_tavg  = 0;
+        real_acc n_n_tavg  = 0;
+        for (int kt=0; kt<nAder; kt++) {
+          h_tavg      += h_DTs   (kt,ii) * dtmult / (kt+1);
+          n_tavg      += n_DTs   (kt,ii) * dtmult / (kt+1);
+          t_tavg      += t_DTs   (kt,ii) * dtmult / (kt+1);
+          surf_tavg   += surf_DTs(kt,ii) * dtmult / (kt+1);
+          n_dtdn_tavg   += n_dtdn_DTs(kt,ii) * dtmult / (kt+1);
+          h_n_tavg    += h_n_DTs (kt,ii) * dtmult / (kt+1);
+          n_n_tavg    += n_n_DTs (kt,ii) * dtmult / (kt+1);
+          dtmult *= dt;
+        }
+        h_DTs   (0,ii) = h_tavg;
+        n_DTs   (0,ii) = n_tavg;
+        t_DTs   (0,ii) = t_tavg;
+        surf_DTs(0,ii) = surf_tavg;
+        n_dtdn_DTs(0,ii) = n_dtdn_tavg;
+        h_n_DTs (0,ii) = h_n_tavg;
+        n_n_DTs (0,ii) = n_n_tavg;
+        SArray<real_acc,1,num_tracers_arr> c_tavg;
+        for (int tr=0; tr < num_tracers; tr++) { c_tavg(tr) = 0; }
+        dtmult = 1;
+        for (int kt=0; kt<nAder; kt++) {
+          for (int tr=0; tr < num_tracers; tr++) { c_tavg(tr) += c_DTs(kt,ii,tr) * dtmult / (kt+1); }
+          dtmult *= dt;
+        }
+        for (int tr=0; tr < num_tracers; tr++) { c_DTs(0,ii,tr) = c_tavg(tr); }
+      }
     }
 
+    // Edge estimates at the lower and upper edges of the cell
+    lim_lo(idH   ) = h_DTs   (0,0     );
+    lim_hi(idH   ) = h_DTs   (0,ngll-1);
+    lim_lo(idN   ) = n_DTs   (0,0     );
+    lim_hi(idN   ) = n_DTs   (0,ngll-1);
+    lim_lo(idT   ) = t_DTs   (0,0     );
+    lim_hi(idT   ) = t_DTs   (0,ngll-1);
+    lim_lo(idSurf) = surf_DTs(0,0     );
+    lim_hi(idSurf) = surf_DTs(0,ngll-1);
+    lim_lo(idHN  ) = h_n_DTs (0,0     );
+    lim_hi(idHN  ) = h_n_DTs (0,ngll-1);
+    lim_lo(idNN  ) = n_n_DTs (0,0     );
+    lim_hi(idNN  ) = n_n_DTs (0,ngll-1);
+    for (int tr=0; tr < num_tracers; tr++) {
+      lim_lo(idTr+tr) = c_DTs(0,0     ,tr);
+      lim_hi(idTr+tr) = c_DTs(0,ngll-1,tr);
+    }
 
+    // Compute the "centered" contribution to the high-order tendency
+    tend_t = 0;
+    if (! sim1d) {
+      for (int ii=0; ii<ngll; ii++) {
+        tend_t += -n_dtdn_DTs(0,ii) * gllWts_ngll(ii);
+      }
+    }
   }
 
 
 
   // ord stencil values to ngll GLL values and ngll GLL derivatives; store in DTs
-  YAKL_INLINE void reconstruct_gll_values_and_derivs( SArray<real,1,ord> const &stencil , SArray<real,2,nAder,ngll> &DTs ,
+  YAKL_INLINE static void reconstruct_gll_values_and_derivs( SArray<real,1,ord> const &stencil , SArray<real,2,nAder,ngll> &DTs ,
                                                       SArray<real,2,nAder,ngll> &deriv_DTs, real dx  ,
                                                       SArray<real,2,ord,ngll> const &s2g , SArray<real,2,ord,ngll> const &s2d2g ,
                                                       SArray<real,2,ord,ngll> const &c2g , SArray<real,2,ord,ngll> const &c2d2g ,
@@ -2229,8 +3180,8 @@ public:
     #endif
     // Transform ord weno coefficients into ngll GLL points
     for (int ii=0; ii<ngll; ii++) {
-      real tmp       = 0;
-      real deriv_tmp = 0;
+      real_acc tmp       = 0;
+      real_acc deriv_tmp = 0;
       for (int s=0; s < ord; s++) {
         real coef = wenoCoefs(s);
         tmp       += c2g  (s,ii) * coef;
@@ -2243,8 +3194,45 @@ public:
 
 
 
+  // reconstruct_gll_values_and_derivs for a batch of N stencils, e.g., a cell's tracers, with the batch index
+  // innermost in the stencils and in DTs and deriv_DTs
+  template <unsigned int N>
+  YAKL_INLINE static void reconstruct_gll_values_and_derivs_batch( SArray<real,2,ord,N> const &stencils ,
+                                                            SArray<real,3,nAder,ngll,N> &DTs ,
+                                                            SArray<real,3,nAder,ngll,N> &deriv_DTs , real dx ,
+                                                            SArray<real,2,ord,ngll> const &c2g ,
+                                                            SArray<real,2,ord,ngll> const &c2d2g ,
+                                                            weno::wt_type const &idl , real sigma ,
+                                                            SArray<real,3,ord,ord,ord> const &weno_recon ) {
+    int constexpr nb = N;  // Batch size
+    // Reconstruct values
+    SArray<real,2,ord,N> wenoCoefs;
+    #if (ORD > 1)
+      weno::compute_weno_coefs_batch( weno_recon , stencils , wenoCoefs , idl , sigma );
+    #endif
+    // Transform ord weno coefficients into ngll GLL points
+    for (int ii=0; ii<ngll; ii++) {
+      SArray<real_acc,1,N> tmp;
+      SArray<real_acc,1,N> deriv_tmp;
+      for (int n=0; n < nb; n++) { tmp(n) = 0;  deriv_tmp(n) = 0; }
+      for (int s=0; s < ord; s++) {
+        for (int n=0; n < nb; n++) {
+          real coef = wenoCoefs(s,n);
+          tmp      (n) += c2g  (s,ii) * coef;
+          deriv_tmp(n) += c2d2g(s,ii) * coef;
+        }
+      }
+      for (int n=0; n < nb; n++) {
+        DTs      (0,ii,n) = tmp(n);
+        deriv_DTs(0,ii,n) = deriv_tmp(n) / dx;
+      }
+    }
+  }
+
+
+
   // ord stencil values to ngll GLL values; store in DTs
-  YAKL_INLINE void reconstruct_gll_values( SArray<real,1,ord> const stencil , SArray<real,2,nAder,ngll> &DTs ,
+  YAKL_INLINE static void reconstruct_gll_values( SArray<real,1,ord> const stencil , SArray<real,2,nAder,ngll> &DTs ,
                                            SArray<real,2,ord,ngll> const &s2g , SArray<real,2,ord,ngll> const &c2g ,
                                            weno::wt_type const &idl , real sigma ,
                                            SArray<real,3,ord,ord,ord> const &weno_recon ) {
@@ -2255,7 +3243,7 @@ public:
     #endif
     // Transform ord weno coefficients into ngll GLL points
     for (int ii=0; ii<ngll; ii++) {
-      real tmp = 0;
+      real_acc tmp = 0;
       for (int s=0; s < ord; s++) {
         tmp += c2g(s,ii) * wenoCoefs(s);
       }
@@ -2266,7 +3254,7 @@ public:
 
 
   // ord stencil values to ngll GLL values; store in DTs
-  YAKL_INLINE void reconstruct_gll_values( SArray<real,1,ord> const stencil , SArray<real,1,ngll> &gll ,
+  YAKL_INLINE static void reconstruct_gll_values( SArray<real,1,ord> const stencil , SArray<real,1,ngll> &gll ,
                                            SArray<real,2,ord,ngll> const &s2g , SArray<real,2,ord,ngll> const &c2g ,
                                            weno::wt_type const &idl , real sigma ,
                                            SArray<real,3,ord,ord,ord> const &weno_recon ) {
@@ -2277,7 +3265,7 @@ public:
     #endif
     // Transform ord weno coefficients into ngll GLL points
     for (int ii=0; ii<ngll; ii++) {
-      real tmp = 0;
+      real_acc tmp = 0;
       for (int s=0; s < ord; s++) {
         tmp += c2g(s,ii) * wenoCoefs(s);
       }
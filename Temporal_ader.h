@@ -2,6 +2,7 @@
 #pragma once
 
 #include "const.h"
+#include "Timers.h"
 
 bool constexpr time_avg = true;
 int  constexpr nAder    = ngll;
@@ -10,6 +11,9 @@ template <class Spatial>
 class Temporal_operator {
 public:
 
+  // Evaluations of the spatial operator in each split of a time step
+  int static constexpr num_stages = 1;
+
   real3d tend;
   Spatial space_op;
 
@@ -46,8 +50,12 @@ public:
 
 
   inline void time_step( real3d &state , real dt ) {
+    TIMER_START("time_step");
+    auto envelope = space_op.envelope_update( dt );
+    int  nsplit   = space_op.num_split();
+
     // Loop over different items in the spatial splitting
-    for (int spl = 0 ; spl < space_op.num_split() ; spl++) {
+    for (int spl = 0 ; spl < nsplit ; spl++) {
       space_op.compute_tendencies( state , tend , dt , spl );
 
       YAKL_SCOPE( tend , this->tend );
@@ -57,11 +65,19 @@ public:
       int constexpr idH = Spatial::idH;
       int constexpr idU = Spatial::idU;
       int constexpr idV = Spatial::idV;
-      parallel_for( SimpleBounds<3>(num_state, space_op.ny, space_op.nx) , YAKL_LAMBDA (int l, int j, int i) {
-        state(l,hs+j,hs+i) += dt * tend(l,j,i);
+      // The last item's update also accumulates the envelope statistics of the final state
+      bool last = spl == nsplit-1 && envelope.active;
+      TIMER_START("update");
+      parallel_for( SimpleBounds<2>(space_op.ny, space_op.nx) , YAKL_LAMBDA (int j, int i) {
+        for (int l=0; l < num_state; l++) {
+          state(l,hs+j,hs+i) += dt * tend(l,j,i);
+        }
+        if (last) { envelope( state , j , i ); }
       });
+      TIMER_STOP("update");
     }
     space_op.switch_dimensions();
+    TIMER_STOP("time_step");
   }
 
 
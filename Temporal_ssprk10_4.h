@@ -2,6 +2,7 @@
 #pragma once
 
 #include "const.h"
+#include "Timers.h"
 
 bool constexpr time_avg = false;
 int  constexpr nAder    = 1;
@@ -9,6 +10,9 @@ int  constexpr nAder    = 1;
 template <class Spatial> class Temporal_operator {
 public:
 
+  // Evaluations of the spatial operator in each split of a time step
+  int static constexpr num_stages = 10;
+
   real3d tmp;
   real3d tmp4;
   real3d tend;
@@ -55,9 +59,11 @@ public:
     int ny        = tendAccum.dimension[1];
     int nx        = tendAccum.dimension[2];
 
+    TIMER_START("tendency_accum");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tendAccum(l,j,i) = 0;
     });
+    TIMER_STOP("tendency_accum");
   }
 
 
@@ -66,13 +72,16 @@ public:
     int ny        = tendAccum.dimension[1];
     int nx        = tendAccum.dimension[2];
 
+    TIMER_START("tendency_accum");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tendAccum(l,j,i) += tend(l,j,i);
     });
+    TIMER_STOP("tendency_accum");
   }
 
 
   void time_step( real3d &state , real dt ) {
+    TIMER_START("time_step");
     YAKL_SCOPE( tend       , this->tend       );
     YAKL_SCOPE( tmp        , this->tmp        );
     YAKL_SCOPE( tendAccum  , this->tendAccum  );
@@ -93,9 +102,11 @@ public:
       space_op.compute_tendencies( state , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = state(l,hs+j,hs+i) + dt/6 * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 2
@@ -105,9 +116,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 3
@@ -117,9 +130,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 4
@@ -129,9 +144,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp4(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 5
@@ -141,17 +158,21 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////
     // Intermediate junk
     /////////////////////////////////
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       state(l,hs+j,hs+i) = 1./25.*state(l,hs+j,hs+i) + 9./25.*tmp(l,hs+j,hs+i);
       tmp  (l,hs+j,hs+i) = 15.*state(l,hs+j,hs+i) - 5.*tmp(l,hs+j,hs+i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 6
@@ -161,9 +182,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 7
@@ -173,9 +196,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 8
@@ -185,9 +210,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 9
@@ -197,9 +224,11 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = tmp(l,hs+j,hs+i) + dt/6. * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 10
@@ -209,9 +238,17 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
-    parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-      state(l,hs+j,hs+i) = state(l,hs+j,hs+i) + 3./5.*tmp(l,hs+j,hs+i) + dt/10.*tendAccum(l,j,i);
+    // The update also accumulates the envelope statistics of the final state
+    auto envelope = space_op.envelope_update( dt );
+    TIMER_START("stage_update");
+    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+      for (int l=0; l < num_state; l++) {
+        state(l,hs+j,hs+i) = state(l,hs+j,hs+i) + 3./5.*tmp(l,hs+j,hs+i) + dt/10.*tendAccum(l,j,i);
+      }
+      if (envelope.active) { envelope( state , j , i ); }
     });
+    TIMER_STOP("stage_update");
+    TIMER_STOP("time_step");
   }
 
 
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "const.h"
+#include "Timers.h"
 
 bool constexpr time_avg = false;
 int  constexpr nAder    = 1;
@@ -9,6 +10,9 @@ int  constexpr nAder    = 1;
 template <class Spatial> class Temporal_operator {
 public:
 
+  // Evaluations of the spatial operator in each split of a time step
+  int static constexpr num_stages = 3;
+
   real3d tmp;
   real3d tend;
   real3d tendAccum;
@@ -53,9 +57,11 @@ public:
     int ny        = tendAccum.dimension[1];
     int nx        = tendAccum.dimension[2];
 
+    TIMER_START("tendency_accum");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tendAccum(l,j,i) = 0;
     });
+    TIMER_STOP("tendency_accum");
   }
 
 
@@ -64,13 +70,16 @@ public:
     int ny        = tendAccum.dimension[1];
     int nx        = tendAccum.dimension[2];
 
+    TIMER_START("tendency_accum");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tendAccum(l,j,i) += tend(l,j,i);
     });
+    TIMER_STOP("tendency_accum");
   }
 
 
   void time_step( real3d &state , real dt ) {
+    TIMER_START("time_step");
     YAKL_SCOPE( tend       , this->tend       );
     YAKL_SCOPE( tmp        , this->tmp        );
     YAKL_SCOPE( tendAccum  , this->tendAccum  );
@@ -88,9 +97,11 @@ public:
       space_op.compute_tendencies( state , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = state(l,hs+j,hs+i) + dt * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 2
@@ -100,11 +111,13 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
+    TIMER_START("stage_update");
     parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
       tmp(l,hs+j,hs+i) = 0.75_fp * state(l,hs+j,hs+i) + 
                          0.25_fp * tmp  (l,hs+j,hs+i) +
                          0.25_fp * dt * tendAccum(l,j,i);
     });
+    TIMER_STOP("stage_update");
 
     /////////////////////////////////////
     // Stage 3
@@ -114,11 +127,19 @@ public:
       space_op.compute_tendencies( tmp , tend , dt , spl );
       tendency_accum( tendAccum , tend );
     }
-    parallel_for( SimpleBounds<3>(num_state,ny,nx) , YAKL_LAMBDA (int l, int j, int i) {
-      state(l,hs+j,hs+i) = (1._fp/3._fp) * state(l,hs+j,hs+i) + 
-                           (2._fp/3._fp) * tmp  (l,hs+j,hs+i) +
-                           (2._fp/3._fp) * dt * tendAccum(l,j,i);
+    // The update also accumulates the envelope statistics of the final state
+    auto envelope = space_op.envelope_update( dt );
+    TIMER_START("stage_update");
+    parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+      for (int l=0; l < num_state; l++) {
+        state(l,hs+j,hs+i) = (1._fp/3._fp) * state(l,hs+j,hs+i) + 
+                             (2._fp/3._fp) * tmp  (l,hs+j,hs+i) +
+                             (2._fp/3._fp) * dt * tendAccum(l,j,i);
+      }
+      if (envelope.active) { envelope( state , j , i ); }
     });
+    TIMER_STOP("stage_update");
+    TIMER_STOP("time_step");
   }
 
 
@@ -0,0 +1,470 @@
+
+#pragma once
+
+#include "const.h"
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#ifdef __ENABLE_PERF_COUNTERS__
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+  #include <sys/ioctl.h>
+  #include <unistd.h>
+  #include <cstring>
+  #include <cstdint>
+  #ifndef __ENABLE_TIMERS__
+    #define __ENABLE_TIMERS__
+  #endif
+#endif
+
+
+// Named timers of the model's phases, built with -D__ENABLE_TIMERS__ and otherwise compiled out entirely.
+// TIMER_START(name) and TIMER_STOP(name) bracket a region. A timer started while another is running is that
+// timer's child, so the same name under different parents is a different timer. Both fence the device, so a
+// region's time includes its kernels on asynchronous backends. TIMERS_REPORT(cells) prints every timer's calls
+// and total time, indented under its parent, with the mean, min, and max of the totals across ranks. cells is
+// the number of cells of the rank's grid, which the hardware counters below are reported per.
+//
+// Building with -D__ENABLE_PERF_COUNTERS__ also enables the timers and has each one count the CPU's cycles,
+// instructions, and last-level cache misses through perf_event_open on Linux, with no other tools needed. Define
+// PERF_FP_EVENT as a raw event code to count floating-point operations too, since their event depends on the
+// CPU, e.g., 0xff03 (RETIRED_SSE_AVX_FLOPS) on AMD Zen, or 0x01c7 (FP_ARITH_INST_RETIRED.SCALAR_DOUBLE) on
+// Intel for scalar code. The report adds each timer's IPC, and per call and cell its instructions, bytes from
+// memory (a cache line per miss), and flops. Only the thread that starts a timer is counted, which is all of a
+// rank on the CPU builds. When the kernel refuses the counters (e.g., perf_event_paranoid > 2 or a VM without a
+// PMU), the report says so and shows only the times.
+//
+// After trace_start(file,max_events), every timed region is also recorded as an event with its rank and thread,
+// up to max_events per rank, and trace_write() merges the ranks' events into file in Chrome's trace format, which
+// Perfetto and chrome://tracing show as a timeline. Timers started on a thread other than the first, like the
+// background writer's, only appear in the trace. Timer names must be string literals, since events point to them.
+#ifdef __ENABLE_TIMERS__
+  #define TIMER_START(name) Timers::start(name)
+  #define TIMER_STOP(name)  Timers::stop(name)
+  #define TIMERS_REPORT(cells) Timers::report(cells)
+#else
+  #define TIMER_START(name)
+  #define TIMER_STOP(name)
+  #define TIMERS_REPORT(cells)
+#endif
+
+
+class Timers {
+public:
+
+  typedef std::chrono::steady_clock Clock;
+
+  // Hardware counters: cycles, instructions, last-level cache misses, and floating-point operations
+  int static constexpr num_counters = 4;
+  int static constexpr cnt_cycles   = 0;
+  int static constexpr cnt_instr    = 1;
+  int static constexpr cnt_misses   = 2;
+  int static constexpr cnt_fp       = 3;
+
+  struct Timer {
+    std::string       name;
+    int               parent;  // Index of the timer this one runs within, or -1
+    long              calls;
+    double            total;   // Seconds
+    Clock::time_point begin;
+    long long         counts      [num_counters];
+    long long         begin_counts[num_counters];
+  };
+
+  // A timed region of the trace: microseconds since the trace started, and the thread's index on this rank
+  struct Event {
+    char const *name;
+    int         thread;
+    double      begin;
+    double      duration;
+  };
+
+  struct Registry {
+    std::vector<Timer> timers;   // Parents always come before their children
+    std::vector<int>   running;  // Indices of the running timers, innermost last
+    // The group of hardware counters read together through its leader (negative when they aren't available),
+    // and which counter each value read belongs to
+    int                leader;
+    std::vector<int>   counters;
+    // Trace of the timed regions, which holds at most its capacity of events and counts those that didn't fit
+    bool               tracing;
+    std::string        trace_file;
+    Clock::time_point  trace_begin;
+    std::vector<Event> events;
+    long               dropped;
+    std::mutex         trace_mtx;
+
+    Registry() { open_counters(*this); }
+  };
+
+
+  static Registry &registry() {
+    static Registry reg;
+    return reg;
+  }
+
+
+  // Index of the calling thread: 0 for the thread that first used the timers, and 1, 2, ... for the others in
+  // the order they first did
+  static int thread_index() {
+    static std::atomic<int> num_threads(0);
+    thread_local int index = num_threads++;
+    return index;
+  }
+
+
+  // Open the hardware counters of the calling thread as one group, leaving out any the CPU doesn't have, and
+  // make it the first thread
+  static void open_counters(Registry &reg) {
+    thread_index();
+    reg.tracing = false;
+    reg.dropped = 0;
+    reg.leader  = -1;
+    #ifdef __ENABLE_PERF_COUNTERS__
+      unsigned long long config[num_counters] = { PERF_COUNT_HW_CPU_CYCLES , PERF_COUNT_HW_INSTRUCTIONS ,
+                                                  PERF_COUNT_HW_CACHE_MISSES , 0 };
+      for (int c=0; c < num_counters; c++) {
+        struct perf_event_attr attr;
+        std::memset( &attr , 0 , sizeof(attr) );
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = config[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+        if (c == cnt_fp) {
+          #ifdef PERF_FP_EVENT
+            attr.type   = PERF_TYPE_RAW;
+            attr.config = PERF_FP_EVENT;
+          #else
+            continue;
+          #endif
+        }
+        // The leader starts disabled, so the whole group starts counting together
+        attr.disabled = reg.leader < 0;
+        int fd = syscall( SYS_perf_event_open , &attr , 0 , -1 , reg.leader , 0 );
+        if (fd < 0) { continue; }
+        if (reg.leader < 0) { reg.leader = fd; }
+        reg.counters.push_back(c);
+      }
+      if (reg.leader >= 0) { ioctl( reg.leader , PERF_EVENT_IOC_ENABLE , 0 ); }
+    #endif
+  }
+
+
+  // Current values of the hardware counters, zero for those that aren't available
+  static void read_counters(Registry const &reg, long long *counts) {
+    for (int c=0; c < num_counters; c++) { counts[c] = 0; }
+    #ifdef __ENABLE_PERF_COUNTERS__
+      if (reg.leader < 0) { return; }
+      uint64_t buf[1+num_counters];
+      if (read( reg.leader , buf , sizeof(buf) ) <= 0) { return; }
+      for (int k=0; k < (int) buf[0] && k < (int) reg.counters.size(); k++) { counts[reg.counters[k]] = buf[1+k]; }
+    #endif
+  }
+
+
+  static void start(char const *name) {
+    Registry &reg = registry();
+    if (thread_index() != 0) {
+      other_thread_running().push_back( Clock::now() );
+      return;
+    }
+    yakl::fence();
+    int parent = reg.running.empty() ? -1 : reg.running.back();
+    int t = 0;
+    while (t < (int) reg.timers.size() && (reg.timers[t].parent != parent || reg.timers[t].name != name)) { t++; }
+    if (t == (int) reg.timers.size()) {
+      Timer timer;
+      timer.name   = name;
+      timer.parent = parent;
+      timer.calls  = 0;
+      timer.total  = 0;
+      for (int c=0; c < num_counters; c++) { timer.counts[c] = 0; }
+      reg.timers.push_back(timer);
+    }
+    reg.running.push_back(t);
+    read_counters( reg , reg.timers[t].begin_counts );
+    reg.timers[t].begin = Clock::now();
+  }
+
+
+  static void stop(char const *name) {
+    Registry &reg = registry();
+    if (thread_index() != 0) {
+      std::vector<Clock::time_point> &running = other_thread_running();
+      if (running.empty()) { endrun( std::string("ERROR: Timer ") + name + " stopped without being started" ); }
+      trace_event( reg , name , running.back() , Clock::now() );
+      running.pop_back();
+      return;
+    }
+    yakl::fence();
+    Clock::time_point end = Clock::now();
+    long long end_counts[num_counters];
+    read_counters( reg , end_counts );
+    if (reg.running.empty() || reg.timers[reg.running.back()].name != name) {
+      endrun( std::string("ERROR: Timer ") + name + " stopped while it isn't the innermost running timer" );
+    }
+    Timer &timer = reg.timers[reg.running.back()];
+    timer.calls++;
+    timer.total += std::chrono::duration<double>( end - timer.begin ).count();
+    for (int c=0; c < num_counters; c++) { timer.counts[c] += end_counts[c] - timer.begin_counts[c]; }
+    trace_event( reg , name , timer.begin , end );
+    reg.running.pop_back();
+  }
+
+
+  // Begin times of the timers running on a thread other than the first, innermost last
+  static std::vector<Clock::time_point> &other_thread_running() {
+    thread_local std::vector<Clock::time_point> running;
+    return running;
+  }
+
+
+  static void trace_event(Registry &reg, char const *name, Clock::time_point begin, Clock::time_point end) {
+    if (! reg.tracing) { return; }
+    std::unique_lock<std::mutex> lock(reg.trace_mtx);
+    if (reg.events.size() == reg.events.capacity()) { reg.dropped++; return; }
+    Event event;
+    event.name     = name;
+    event.thread   = thread_index();
+    event.begin    = std::chrono::duration<double,std::micro>( begin - reg.trace_begin ).count();
+    event.duration = std::chrono::duration<double,std::micro>( end   - begin           ).count();
+    reg.events.push_back(event);
+  }
+
+
+  // Start recording every timed region, up to max_events of them on this rank, for trace_write() to write to
+  // file. Every rank must call this, and their clocks start together.
+  static void trace_start(std::string file, long max_events) {
+    #ifndef __ENABLE_TIMERS__
+      endrun("ERROR: trace_file needs a build with -D__ENABLE_TIMERS__");
+    #endif
+    Registry &reg = registry();
+    reg.trace_file = file;
+    reg.events.reserve( max_events );
+    #ifdef __ENABLE_MPI__
+      MPI_Barrier( MPI_COMM_WORLD );
+    #endif
+    reg.trace_begin = Clock::now();
+    reg.tracing     = true;
+  }
+
+
+  // Write every rank's trace to the trace file in Chrome's trace format, with a process per rank and a track per
+  // thread. The master writes its own events and then each other rank's in turn, so it only ever holds one
+  // rank's. Every rank must call this, and it does nothing without a trace.
+  static void trace_write() {
+    Registry &reg = registry();
+    if (! reg.tracing) { return; }
+    std::unique_lock<std::mutex> lock(reg.trace_mtx);
+    reg.tracing = false;
+    int  nranks  = 1;
+    int  myrank  = 0;
+    long dropped = reg.dropped;
+    #ifdef __ENABLE_MPI__
+      MPI_Comm_size( MPI_COMM_WORLD , &nranks );
+      MPI_Comm_rank( MPI_COMM_WORLD , &myrank );
+      MPI_Reduce( &reg.dropped , &dropped , 1 , MPI_LONG , MPI_SUM , 0 , MPI_COMM_WORLD );
+    #endif
+
+    // This rank's events, each ending with a comma and a newline
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << myrank
+         << ",\"args\":{\"name\":\"rank " << myrank << "\"}},\n";
+    int num_threads = 1;
+    for (auto const &e : reg.events) { num_threads = std::max( num_threads , e.thread+1 ); }
+    for (int t=0; t < num_threads; t++) {
+      json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << myrank << ",\"tid\":" << t
+           << ",\"args\":{\"name\":\"" << (t == 0 ? "main" : "thread " + std::to_string(t)) << "\"}},\n";
+    }
+    for (auto const &e : reg.events) {
+      json << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":" << myrank << ",\"tid\":" << e.thread
+           << ",\"ts\":" << e.begin << ",\"dur\":" << e.duration << "},\n";
+    }
+    std::string mine = json.str();
+    std::vector<Event>().swap( reg.events );
+
+    if (myrank == 0) {
+      std::ofstream out( reg.trace_file );
+      if (! out) { endrun( "ERROR: Unable to open trace file " + reg.trace_file ); }
+      out << "{\"otherData\":{\"ranks\":" << nranks << ",\"dropped_events\":" << dropped << "},\n"
+          << "\"traceEvents\":[\n" << mine;
+      #ifdef __ENABLE_MPI__
+        for (int r=1; r < nranks; r++) {
+          long len;
+          MPI_Recv( &len , 1 , MPI_LONG , r , 0 , MPI_COMM_WORLD , MPI_STATUS_IGNORE );
+          std::string theirs( len , ' ' );
+          if (len > 0) { MPI_Recv( &theirs[0] , len , MPI_CHAR , r , 1 , MPI_COMM_WORLD , MPI_STATUS_IGNORE ); }
+          out << theirs;
+        }
+      #endif
+      // JSON doesn't allow a comma after the last event, so the array ends with an empty one
+      out << "{}]}\n";
+      std::cout << "Trace written to " << reg.trace_file;
+      if (dropped > 0) { std::cout << ", leaving out " << dropped << " events beyond trace_max_events"; }
+      std::cout << "\n";
+    } else {
+      #ifdef __ENABLE_MPI__
+        long len = mine.size();
+        MPI_Send( &len , 1 , MPI_LONG , 0 , 0 , MPI_COMM_WORLD );
+        if (len > 0) { MPI_Send( &mine[0] , len , MPI_CHAR , 0 , 1 , MPI_COMM_WORLD ); }
+      #endif
+    }
+  }
+
+
+  // Full name of timer t: its parents' names and its own, separated by slashes
+  static std::string path(int t) {
+    Timer const &timer = registry().timers[t];
+    return timer.parent < 0 ? timer.name : path(timer.parent) + "/" + timer.name;
+  }
+
+
+  // Print the master process's timers. Every rank must call this, and a rank that never ran one of them counts
+  // zero time for it. cells is the number of cells of the rank's grid, for the hardware counters per cell.
+  static void report(long cells) {
+    Registry           const &reg    = registry();
+    std::vector<Timer> const &timers = reg.timers;
+    std::vector<std::string> paths;
+    for (int t=0; t < (int) timers.size(); t++) { paths.push_back( path(t) ); }
+    int nranks     = 1;
+    int masterproc = 1;
+    #ifdef __ENABLE_MPI__
+      int myrank;
+      MPI_Comm_size( MPI_COMM_WORLD , &nranks );
+      MPI_Comm_rank( MPI_COMM_WORLD , &myrank );
+      masterproc = myrank == 0;
+      // Send the master's timers to every rank as one string of newline-terminated paths
+      std::string list;
+      if (masterproc) { for (auto const &p : paths) { list += p + "\n"; } }
+      int len = list.size();
+      MPI_Bcast( &len , 1 , MPI_INT , 0 , MPI_COMM_WORLD );
+      list.resize( len );
+      if (len > 0) { MPI_Bcast( &list[0] , len , MPI_CHAR , 0 , MPI_COMM_WORLD ); }
+      std::vector<std::string> master_paths;
+      for (size_t beg=0, end; (end = list.find('\n',beg)) != std::string::npos; beg = end+1) {
+        master_paths.push_back( list.substr(beg,end-beg) );
+      }
+    #else
+      std::vector<std::string> master_paths = paths;
+    #endif
+
+    int n = master_paths.size();
+    std::vector<double> total(n);
+    for (int k=0; k < n; k++) {
+      int t = std::find( paths.begin() , paths.end() , master_paths[k] ) - paths.begin();
+      total[k] = t < (int) paths.size() ? timers[t].total : 0;
+    }
+    std::vector<double> total_sum = total;
+    std::vector<double> total_min = total;
+    std::vector<double> total_max = total;
+    #ifdef __ENABLE_MPI__
+      if (n > 0) {
+        MPI_Reduce( total.data() , total_sum.data() , n , MPI_DOUBLE , MPI_SUM , 0 , MPI_COMM_WORLD );
+        MPI_Reduce( total.data() , total_min.data() , n , MPI_DOUBLE , MPI_MIN , 0 , MPI_COMM_WORLD );
+        MPI_Reduce( total.data() , total_max.data() , n , MPI_DOUBLE , MPI_MAX , 0 , MPI_COMM_WORLD );
+      }
+    #endif
+
+    #ifdef __ENABLE_PERF_COUNTERS__
+      // Hardware counts summed over ranks, and which counters every rank has
+      std::vector<double> counts_sum(n*num_counters,0);
+      for (int k=0; k < n; k++) {
+        int t = std::find( paths.begin() , paths.end() , master_paths[k] ) - paths.begin();
+        for (int c=0; c < num_counters && t < (int) paths.size(); c++) { counts_sum[k*num_counters+c] = timers[t].counts[c]; }
+      }
+      int have[num_counters];
+      for (int c=0; c < num_counters; c++) {
+        have[c] = std::find( reg.counters.begin() , reg.counters.end() , c ) != reg.counters.end();
+      }
+      double cells_sum = cells;
+      #ifdef __ENABLE_MPI__
+        if (n > 0) {
+          MPI_Allreduce( MPI_IN_PLACE , counts_sum.data() , n*num_counters , MPI_DOUBLE , MPI_SUM , MPI_COMM_WORLD );
+        }
+        MPI_Allreduce( MPI_IN_PLACE , have       , num_counters , MPI_INT    , MPI_MIN , MPI_COMM_WORLD );
+        MPI_Allreduce( MPI_IN_PLACE , &cells_sum , 1            , MPI_DOUBLE , MPI_SUM , MPI_COMM_WORLD );
+      #endif
+    #endif
+
+    if (masterproc) {
+      std::cout << "Timers in seconds (total: mean over ranks, mean: per call, min / max: totals across ranks)\n";
+      std::cout << std::left << std::setw(40) << "timer" << std::right << std::setw(10) << "calls"
+                << std::setw(12) << "total" << std::setw(12) << "mean" << std::setw(12) << "min"
+                << std::setw(12) << "max" << "\n";
+      report_children( -1 , 0 , total_sum , total_min , total_max , nranks );
+      #ifdef __ENABLE_PERF_COUNTERS__
+        if (! have[cnt_cycles]) {
+          std::cout << "Hardware counters are unavailable (see perf_event_paranoid), only times are reported\n";
+        } else {
+          std::cout << "Hardware counters (totals over ranks; instr, bytes, and flops per call and cell; bytes are "
+                    << "last-level cache misses times 64; - where the CPU has no counter)\n";
+          std::cout << std::left << std::setw(40) << "timer" << std::right << std::setw(12) << "cycles"
+                    << std::setw(12) << "instr" << std::setw(8) << "ipc" << std::setw(12) << "llc_misses"
+                    << std::setw(12) << "fp_ops" << std::setw(12) << "instr/cell" << std::setw(12) << "bytes/cell"
+                    << std::setw(12) << "flops/cell" << "\n";
+          report_counters( -1 , 0 , counts_sum , have , cells_sum );
+        }
+      #endif
+    }
+  }
+
+
+  // Print the hardware counts of the timers within parent, each followed by its own children
+  static void report_counters(int parent, int depth, std::vector<double> const &counts_sum, int const *have,
+                              double cells_sum) {
+    std::vector<Timer> const &timers = registry().timers;
+    for (int t=0; t < (int) timers.size(); t++) {
+      if (timers[t].parent != parent) { continue; }
+      double const *counts = &counts_sum[t*num_counters];
+      double per_cell = 1. / ( std::max( timers[t].calls , 1L ) * std::max( cells_sum , 1. ) );
+      std::ostringstream line;
+      line << std::left << std::setw(40) << std::string(2*depth,' ') + timers[t].name << std::right
+           << std::scientific << std::setprecision(3);
+      auto value = [&] (bool avail, double val, int width) {
+        if (avail) { line << std::setw(width) << val; } else { line << std::setw(width) << "-"; }
+      };
+      value( true              , counts[cnt_cycles] , 12 );
+      value( have[cnt_instr ]  , counts[cnt_instr ] , 12 );
+      line << std::fixed << std::setprecision(2);
+      value( have[cnt_instr ] && counts[cnt_cycles] > 0 , counts[cnt_instr] / std::max( counts[cnt_cycles] , 1. ) , 8 );
+      line << std::scientific << std::setprecision(3);
+      value( have[cnt_misses]  , counts[cnt_misses] , 12 );
+      value( have[cnt_fp    ]  , counts[cnt_fp    ] , 12 );
+      line << std::fixed << std::setprecision(1);
+      value( have[cnt_instr ]  , counts[cnt_instr ] * per_cell , 12 );
+      value( have[cnt_misses]  , counts[cnt_misses] * 64 * per_cell , 12 );
+      value( have[cnt_fp    ]  , counts[cnt_fp    ] * per_cell , 12 );
+      line << "\n";
+      std::cout << line.str();
+      report_counters( t , depth+1 , counts_sum , have , cells_sum );
+    }
+  }
+
+
+  // Print the timers within parent, each followed by its own children
+  static void report_children(int parent, int depth, std::vector<double> const &total_sum,
+                              std::vector<double> const &total_min, std::vector<double> const &total_max, int nranks) {
+    std::vector<Timer> const &timers = registry().timers;
+    for (int t=0; t < (int) timers.size(); t++) {
+      if (timers[t].parent != parent) { continue; }
+      double total = total_sum[t] / nranks;
+      std::ostringstream line;
+      line << std::left << std::setw(40) << std::string(2*depth,' ') + timers[t].name << std::right
+           << std::setw(10) << timers[t].calls << std::scientific << std::setprecision(3)
+           << std::setw(12) << total << std::setw(12) << total / std::max( timers[t].calls , 1L )
+           << std::setw(12) << total_min[t] << std::setw(12) << total_max[t] << "\n";
+      std::cout << line.str();
+      report_children( t , depth+1 , total_sum , total_min , total_max , nranks );
+    }
+  }
+
+};
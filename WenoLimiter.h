@@ -11,8 +11,8 @@ namespace weno {
 
   typedef SArray<real,1,hs+2> wt_type;
 
-  template <unsigned int N>
-  YAKL_INLINE void map_weights( SArray<real,1,N> const &idl , SArray<real,1,N> &wts ) {
+  template <class T, unsigned int N>
+  YAKL_INLINE void map_weights( SArray<real,1,N> const &idl , SArray<T,1,N> &wts ) {
     // Map the weights for quicker convergence. WARNING: Ideal weights must be (0,1) before mapping
     for (int i=0; i<N; i++) {
       wts(i) = wts(i) * ( idl(i) + idl(i)*idl(i) - 3._fp*idl(i)*wts(i) + wts(i)*wts(i) ) / ( idl(i)*idl(i) + wts(i) * ( 1._fp - 2._fp * idl(i) ) );
@@ -20,10 +20,10 @@ namespace weno {
   }
 
 
-  template <unsigned int N>
-  YAKL_INLINE void convexify( SArray<real,1,N> &wts ) {
-    real sum = 0._fp;
-    real const eps = 1.0e-20;
+  template <class T, unsigned int N>
+  YAKL_INLINE void convexify( SArray<T,1,N> &wts ) {
+    T sum = 0._fp;
+    T const eps = 1.0e-20;
     for (int i=0; i<N; i++) { sum += wts(i); }
     for (int i=0; i<N; i++) { wts(i) /= (sum + eps); }
   }
@@ -99,13 +99,15 @@ namespace weno {
   YAKL_INLINE void compute_weno_coefs( SArray<real,3,ord,ord,ord> const &recon , SArray<real,1,ord> const &u ,
                                        SArray<real,1,ord> &aw , SArray<real,1,hs+2> const &idl , real const sigma ) {
 
-    SArray<real,1,hs+2> tv;
-    SArray<real,1,hs+2> wts;
-    SArray<real,2,hs+2,ord> a;
-    SArray<real,1,hs+1> lotmp;
-    SArray<real,1,ord > hitmp;
-    real lo_avg;
-    real const eps = 1.0e-20;
+    // Polynomials, TV, and weights are computed in real_acc since the bridge polynomial and TV**2 are
+    // sensitive to round-off
+    SArray<real_acc,1,hs+2> tv;
+    SArray<real_acc,1,hs+2> wts;
+    SArray<real_acc,2,hs+2,ord> a;
+    SArray<real_acc,1,hs+1> lotmp;
+    SArray<real_acc,1,ord > hitmp;
+    real_acc lo_avg;
+    real_acc const eps = 1.0e-20;
 
     // Init to zero
     for (int j=0; j<hs+2; j++) {
@@ -169,25 +171,134 @@ namespace weno {
     convexify(wts);
 
     // WENO polynomial is the weighted sum of candidate polynomials using WENO weights instead of ideal weights
-    for (int i=0; i<ord; i++) {
-      aw(i) = 0._fp;
+    for (int ii=0; ii<ord; ii++) {
+      real_acc tmp = 0._fp;
+      for (int i=0; i<hs+2; i++) {
+        tmp += wts(i) * a(i,ii);
+      }
+      aw(ii) = tmp;
     }
-    for (int i=0; i<hs+2; i++) {
+  }
+
+
+  // compute_weno_coefs for a batch of N stencils at once, e.g., every tracer of a cell, stored with the batch
+  // index innermost so each step's loop over the batch is contiguous. Each stencil's coefficients are
+  // computed exactly as compute_weno_coefs computes them.
+  template <unsigned int N>
+  YAKL_INLINE void compute_weno_coefs_batch( SArray<real,3,ord,ord,ord> const &recon , SArray<real,2,ord,N> const &u ,
+                                             SArray<real,2,ord,N> &aw , SArray<real,1,hs+2> const &idl ,
+                                             real const sigma ) {
+    int constexpr nb = N;  // Batch size
+    SArray<real_acc,2,hs+2,N> tv;
+    SArray<real_acc,2,hs+2,N> wts;
+    SArray<real_acc,3,hs+2,ord,N> a;
+    SArray<real_acc,1,hs+1> lotmp;
+    SArray<real_acc,1,ord > hitmp;
+    SArray<real_acc,1,N> sum;
+    real_acc const eps = 1.0e-20;
+
+    // Init to zero
+    for (int j=0; j<hs+2; j++) {
+      for (int i=0; i<ord; i++) {
+        for (int n=0; n<nb; n++) { a(j,i,n) = 0._fp; }
+      }
+    }
+
+    // Compute three quadratic polynomials (left, center, and right) and the high-order polynomial
+    for(int i=0; i<hs+1; i++) {
+      for (int ii=0; ii<hs+1; ii++) {
+        for (int s=0; s<hs+1; s++) {
+          for (int n=0; n<nb; n++) { a(i,ii,n) += recon(i,s,ii) * u(i+s,n); }
+        }
+      }
+    }
+    for (int ii=0; ii<ord; ii++) {
+      for (int s=0; s<ord; s++) {
+        for (int n=0; n<nb; n++) { a(hs+1,ii,n) += recon(hs+1,s,ii) * u(s,n); }
+      }
+    }
+
+    // Compute "bridge" polynomial
+    for (int i=0; i<hs+1; i++) {
+      for (int ii=0; ii<hs+1; ii++) {
+        for (int n=0; n<nb; n++) { a(hs+1,ii,n) -= idl(i)*a(i,ii,n); }
+      }
+    }
+    for (int ii=0; ii<ord; ii++) {
+      for (int n=0; n<nb; n++) { a(hs+1,ii,n) /= idl(hs+1); }
+    }
+
+    // Compute total variation of all candidate polynomials
+    for (int n=0; n<nb; n++) {
+      for (int i=0; i<hs+1; i++) {
+        for (int ii=0; ii<hs+1; ii++) {
+          lotmp(ii) = a(i,ii,n);
+        }
+        tv(i,n) = TransformMatrices::coefs_to_tv(lotmp);
+      }
       for (int ii=0; ii<ord; ii++) {
-        aw(ii) += wts(i) * a(i,ii);
+        hitmp(ii) = a(hs+1,ii,n);
+      }
+      tv(hs+1,n) = TransformMatrices::coefs_to_tv(hitmp);
+    }
+
+    // Reduce the bridge polynomial TV to something closer to the other TV values
+    for (int n=0; n<nb; n++) { sum(n) = 0._fp; }
+    for (int i=0; i<hs+1; i++) {
+      for (int n=0; n<nb; n++) { sum(n) += tv(i,n); }
+    }
+    for (int n=0; n<nb; n++) {
+      real_acc lo_avg = sum(n) / (hs+1);
+      tv(hs+1,n) = lo_avg + ( tv(hs+1,n) - lo_avg ) * sigma;
+    }
+
+    // WENO weights are proportional to the inverse of TV**2 and then re-confexified
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) { wts(i,n) = idl(i) / ( tv(i,n)*tv(i,n) + eps ); }
+    }
+    for (int n=0; n<nb; n++) { sum(n) = 0._fp; }
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) { sum(n) += wts(i,n); }
+    }
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) { wts(i,n) /= (sum(n) + eps); }
+    }
+
+    // Map WENO weights for sharper fronts and less sensitivity to "eps"
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) {
+        wts(i,n) = wts(i,n) * ( idl(i) + idl(i)*idl(i) - 3._fp*idl(i)*wts(i,n) + wts(i,n)*wts(i,n) ) /
+                   ( idl(i)*idl(i) + wts(i,n) * ( 1._fp - 2._fp * idl(i) ) );
+      }
+    }
+    for (int n=0; n<nb; n++) { sum(n) = 0._fp; }
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) { sum(n) += wts(i,n); }
+    }
+    for (int i=0; i<hs+2; i++) {
+      for (int n=0; n<nb; n++) { wts(i,n) /= (sum(n) + eps); }
+    }
+
+    // WENO polynomial is the weighted sum of candidate polynomials using WENO weights instead of ideal weights
+    for (int ii=0; ii<ord; ii++) {
+      for (int n=0; n<nb; n++) { sum(n) = 0._fp; }
+      for (int i=0; i<hs+2; i++) {
+        for (int n=0; n<nb; n++) { sum(n) += wts(i,n) * a(i,ii,n); }
       }
+      for (int n=0; n<nb; n++) { aw(ii,n) = sum(n); }
     }
   }
 
 
   YAKL_INLINE void compute_weno_weights( SArray<real,3,ord,ord,ord> const &recon , SArray<real,1,ord> const &u ,
-                                         SArray<real,1,hs+2> const &idl , real const sigma , SArray<real,1,hs+2> &wts ) {
-    SArray<real,1,hs+2> tv;
-    SArray<real,2,hs+2,ord> a;
-    SArray<real,1,hs+1> lotmp;
-    SArray<real,1,ord > hitmp;
-    real lo_avg;
-    real const eps = 1.0e-20;
+                                         SArray<real,1,hs+2> const &idl , real const sigma , SArray<real,1,hs+2> &wts_out ) {
+    SArray<real_acc,1,hs+2> tv;
+    SArray<real_acc,1,hs+2> wts;
+    SArray<real_acc,2,hs+2,ord> a;
+    SArray<real_acc,1,hs+1> lotmp;
+    SArray<real_acc,1,ord > hitmp;
+    real_acc lo_avg;
+    real_acc const eps = 1.0e-20;
 
     // Init to zero
     for (int j=0; j<hs+2; j++) {
@@ -249,6 +360,8 @@ namespace weno {
     // Map WENO weights for sharper fronts and less sensitivity to "eps"
     map_weights(idl,wts);
     convexify(wts);
+
+    for (int i=0; i<hs+2; i++) { wts_out(i) = wts(i); }
   }
 
 
@@ -0,0 +1,301 @@
+
+// Microbenchmarks of the model's numerical kernels in isolation, each run over many cells of random data:
+// the WENO coefficients, the reconstruction to GLL points with and without derivatives, a cell's full
+// reconstruction for a sweep without and with the ADER Cauchy-Kovalevski time derivatives, the characteristic
+// Riemann split, and the halo fill of each boundary condition. ord and ngll are compile time, so each
+// combination is its own executable (see BENCH_CONFIGS in CMakeLists.txt).
+//
+// Usage: bench_kernels_ord<ord>_ngll<ngll> [--cells N] [--reps R] [--json file]
+//
+// Each kernel runs twice to warm up and then R times (default 20), each fenced and timed on its own. Reported
+// are the median ns per cell, the fastest run, and the half-width of the median's 95% confidence interval from
+// the order statistics, along with GFLOP/s and GB/s at the median. Flops are counted from the kernels' loops, with
+// divides and square roots as one, and bytes are each cell's inputs read and outputs written once, so both are
+// estimates. --json writes the same results for scripts.
+
+#include "const.h"
+#include "Spatial_swm2d_fv_Agrid.h"
+#include <random>
+#include <functional>
+#include <cstring>
+
+static_assert( ord >= 3 , "The kernel benchmarks need WENO, so ORD must be at least 3" );
+
+typedef Spatial_operator<false,1   > SpatialRK;    // Runge-Kutta builds: the state itself at GLL points
+typedef Spatial_operator<true ,ngll> SpatialADER;  // ADER builds: ngll time derivatives, time averaged
+
+
+struct Result {
+  std::string name;
+  long        cells;
+  double      median;     // Seconds
+  double      fastest;
+  double      ci95;       // Half-width of the median's 95% confidence interval, relative to it
+  double      flops;      // Per cell
+  double      bytes;      // Per cell
+};
+
+
+// Time kernel over reps runs after two to warm up
+Result benchmark(std::string name, long cells, double flops, double bytes, int reps, std::function<void()> kernel) {
+  for (int r=0; r < 2; r++) { kernel(); }
+  yakl::fence();
+  std::vector<double> times(reps);
+  for (int r=0; r < reps; r++) {
+    auto t1 = std::chrono::steady_clock::now();
+    kernel();
+    yakl::fence();
+    auto t2 = std::chrono::steady_clock::now();
+    times[r] = std::chrono::duration<double>(t2-t1).count();
+  }
+  std::sort( times.begin() , times.end() );
+  // Distribution-free confidence interval of the median: the order statistics about 1.96 standard deviations of
+  // a binomial(reps,1/2) either side of the middle
+  int lo = std::max( (int) std::floor( reps/2. - 0.98*std::sqrt((double) reps) ) , 0      );
+  int hi = std::min( (int) std::ceil ( reps/2. + 0.98*std::sqrt((double) reps) ) , reps-1 );
+  Result res;
+  res.name    = name;
+  res.cells   = cells;
+  res.median  = reps % 2 ? times[reps/2] : 0.5*(times[reps/2-1] + times[reps/2]);
+  res.fastest = times[0];
+  res.ci95    = 0.5*(times[hi] - times[lo]) / res.median;
+  res.flops   = flops;
+  res.bytes   = bytes;
+  return res;
+}
+
+
+// Estimated flops of the total variation of a polynomial with n coefficients, a quadratic form in all but the first
+double tv_flops(int n) { return 2.*(n-1)*(n-1); }
+
+
+// Estimated flops of weno::compute_weno_coefs
+double weno_flops() {
+  int p = weno::hs+1;   // Low-order polynomials, each with p coefficients
+  double polys   = 2.*p*p*p + 2.*ord*ord;
+  double bridge  = 2.*p*p + ord;
+  double tv      = p*tv_flops(p) + tv_flops(ord) + p + 4;
+  double weights = 3.*(p+1) + 2*2.*(p+1) + 12.*(p+1);
+  double blend   = 2.*ord*(p+1);
+  return polys + bridge + tv + weights + blend;
+}
+
+
+// Estimated flops of Spatial_operator::reconstruct_cell_limits with nder time derivatives
+double cell_limits_flops(int nder) {
+  double recon = 2*(weno_flops() + 2.*ord*ngll) + (weno_flops() + 4.*ord*ngll + ngll) + 10.*ord + 8.*ngll;
+  double ck    = 0;
+  for (int kt=0; kt < nder-1; kt++) { ck += ngll * ( 6.*ngll + 10 + 2.*ngll + 6.*(kt+2) ); }
+  double tavg  = nder > 1 ? ngll * nder * 7 * 3. : 0;
+  return recon + ck + tavg + 2.*ngll;
+}
+
+
+int main(int argc, char** argv) {
+  yakl::init();
+  {
+    long        cells = 1 << 20;
+    int         reps  = 20;
+    std::string json_file;
+    for (int a=1; a < argc; a++) {
+      if      (! strcmp(argv[a],"--cells") && a+1 < argc) { cells = atol(argv[++a]); }
+      else if (! strcmp(argv[a],"--reps" ) && a+1 < argc) { reps  = atoi(argv[++a]); }
+      else if (! strcmp(argv[a],"--json" ) && a+1 < argc) { json_file = argv[++a]; }
+      else { endrun("Usage: bench_kernels [--cells N] [--reps R] [--json file]"); }
+    }
+    if (cells < 1 || reps < 1) { endrun("ERROR: --cells and --reps must be positive"); }
+
+    int constexpr hs        = SpatialADER::hs;
+    int constexpr num_state = SpatialADER::num_state;
+    int constexpr num_edge  = SpatialADER::num_edge;
+    int  nx = std::min( cells , 1024L );
+    int  ny = (cells + nx - 1) / nx;
+    long n  = (long) nx * ny;
+
+    SpatialADER op;
+    op.init_transforms();
+    auto s2g          = op.sten_to_gll;
+    auto s2d2g        = op.sten_to_deriv_gll;
+    auto c2g          = op.coefs_to_gll;
+    auto c2d2g        = op.coefs_to_deriv_gll;
+    auto deriv_matrix = op.deriv_matrix;
+    auto gllWts_ngll  = op.gllWts_ngll;
+    auto idl          = op.idl;
+    auto sigma        = op.sigma;
+    auto weno_recon   = op.weno_recon;
+    real dx   = 1;
+    real dt   = 0.05;
+    real grav = 9.81;
+
+    // Smooth waves with 10% noise: a lake with a rough surface, flowing both ways
+    std::mt19937_64 gen(0);
+    std::uniform_real_distribution<double> noise(-0.1,0.1);
+    auto wave = [&] (long k, double amp, double mean) { return mean + amp*( std::sin(0.01*k) + noise(gen) ); };
+    realHost1d u_host("u",n+ord-1);
+    for (long k=0; k < n+ord-1; k++) { u_host(k) = wave(k,1,0); }
+    realHost3d state_host("state",num_state,ny+2*hs,nx+2*hs);
+    realHost2d bath_host ("bath" ,ny+2*hs,nx+2*hs);
+    for (int j=0; j < ny+2*hs; j++) {
+      for (int i=0; i < nx+2*hs; i++) {
+        long k = (long) j*(nx+2*hs) + i;
+        bath_host(j,i) = wave(k,0.05,-0.2);
+        state_host(SpatialADER::idH,j,i) = 1 - bath_host(j,i);
+        state_host(SpatialADER::idU,j,i) = wave(k,0.5,0);
+        state_host(SpatialADER::idV,j,i) = wave(k,0.5,0);
+        for (int l=3; l < num_state; l++) { state_host(l,j,i) = state_host(SpatialADER::idH,j,i) * wave(k,0.5,0.5); }
+      }
+    }
+    realHost2d edges_host("edges",12,n);
+    for (long k=0; k < n; k++) {
+      for (int side=0; side < 2; side++) {
+        real h  = wave(k,0.2,1);
+        real un = wave(k,0.5,0);
+        real ut = wave(k,0.5,0);
+        real surf = h + wave(k,0.05,-0.2);
+        edges_host(6*side+0,k) = h;
+        edges_host(6*side+1,k) = un;
+        edges_host(6*side+2,k) = ut;
+        edges_host(6*side+3,k) = surf;
+        edges_host(6*side+4,k) = h*un;
+        edges_host(6*side+5,k) = un*un;
+      }
+    }
+    real1d u     = u_host    .createDeviceCopy();
+    real3d state = state_host.createDeviceCopy();
+    real2d bath  = bath_host .createDeviceCopy();
+    real2d edges = edges_host.createDeviceCopy();
+    real3d bath_gll_n("bath_gll_n",ny,nx,ngll);
+    parallel_for( SimpleBounds<3>(ny,nx,ngll) , YAKL_LAMBDA (int j, int i, int ii) {
+      bath_gll_n(j,i,ii) = bath(hs+j,hs+i);
+    });
+    real2d out("out",2*num_edge+1,n);
+
+    std::vector<Result> results;
+
+    results.push_back( benchmark( "weno_coefs" , n , weno_flops() , 8.*(1+ord) , reps , [&] () {
+      parallel_for( SimpleBounds<1>(n) , YAKL_LAMBDA (int k) {
+        SArray<real,1,ord> stencil;
+        SArray<real,1,ord> coefs;
+        for (int s=0; s < ord; s++) { stencil(s) = u(k+s); }
+        weno::compute_weno_coefs( weno_recon , stencil , coefs , idl , sigma );
+        for (int s=0; s < ord; s++) { out(s,k) = coefs(s); }
+      });
+    }));
+
+    results.push_back( benchmark( "recon_gll" , n , weno_flops() + 2.*ord*ngll , 8.*(1+ngll) , reps , [&] () {
+      parallel_for( SimpleBounds<1>(n) , YAKL_LAMBDA (int k) {
+        SArray<real,1,ord>  stencil;
+        SArray<real,1,ngll> gll;
+        for (int s=0; s < ord; s++) { stencil(s) = u(k+s); }
+        SpatialADER::reconstruct_gll_values( stencil , gll , s2g , c2g , idl , sigma , weno_recon );
+        for (int ii=0; ii < ngll; ii++) { out(ii,k) = gll(ii); }
+      });
+    }));
+
+    results.push_back( benchmark( "recon_gll_derivs" , n , weno_flops() + 4.*ord*ngll + ngll , 8.*(1+2*ngll) , reps ,
+                                  [&] () {
+      parallel_for( SimpleBounds<1>(n) , YAKL_LAMBDA (int k) {
+        SArray<real,1,ord>        stencil;
+        SArray<real,2,ngll,ngll> DTs;
+        SArray<real,2,ngll,ngll> deriv_DTs;
+        for (int s=0; s < ord; s++) { stencil(s) = u(k+s); }
+        SpatialADER::reconstruct_gll_values_and_derivs( stencil , DTs , deriv_DTs , dx , s2g , s2d2g , c2g , c2d2g ,
+                                                        idl , sigma , weno_recon );
+        for (int ii=0; ii < ngll; ii++) { out(ii,k) = DTs(0,ii);  out(ngll+ii,k) = deriv_DTs(0,ii); }
+      });
+    }));
+
+    // A whole cell's reconstruction for an x sweep away from boundaries: the time derivatives and time average
+    // are all that the ADER version adds, which gives the Cauchy-Kovalevski loop's cost
+    double cell_bytes = 8.*(num_state + 1 + ngll + 2*num_edge + 1);
+    results.push_back( benchmark( "cell_limits_rk" , n , cell_limits_flops(1) , cell_bytes , reps , [&] () {
+      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+        SArray<real,1,num_edge> lim_lo, lim_hi;
+        real tend_t;
+        SpatialRK::reconstruct_cell_limits<SpatialRK::DIR_X,SpatialRK::BCOpen>(
+          state , bath , bath_gll_n , j , i , nx , false , false , dx , dt , grav , false , s2g , s2d2g , c2g , c2d2g ,
+          deriv_matrix , gllWts_ngll , idl , sigma , weno_recon , lim_lo , lim_hi , tend_t );
+        long k = (long) j*nx + i;
+        for (int v=0; v < num_edge; v++) { out(v,k) = lim_lo(v);  out(num_edge+v,k) = lim_hi(v); }
+        out(2*num_edge,k) = tend_t;
+      });
+    }));
+
+    results.push_back( benchmark( "cell_limits_ader" , n , cell_limits_flops(ngll) , cell_bytes , reps , [&] () {
+      parallel_for( SimpleBounds<2>(ny,nx) , YAKL_LAMBDA (int j, int i) {
+        SArray<real,1,num_edge> lim_lo, lim_hi;
+        real tend_t;
+        SpatialADER::reconstruct_cell_limits<SpatialADER::DIR_X,SpatialADER::BCOpen>(
+          state , bath , bath_gll_n , j , i , nx , false , false , dx , dt , grav , false , s2g , s2d2g , c2g , c2d2g ,
+          deriv_matrix , gllWts_ngll , idl , sigma , weno_recon , lim_lo , lim_hi , tend_t );
+        long k = (long) j*nx + i;
+        for (int v=0; v < num_edge; v++) { out(v,k) = lim_lo(v);  out(num_edge+v,k) = lim_hi(v); }
+        out(2*num_edge,k) = tend_t;
+      });
+    }));
+
+    results.push_back( benchmark( "riemann" , n , 40 , 8.*(12+4) , reps , [&] () {
+      parallel_for( SimpleBounds<1>(n) , YAKL_LAMBDA (int k) {
+        real fw_h, fw_n, fw_t_L, fw_t_R;
+        SpatialADER::split_flux_difference( edges(0,k) , edges(1,k) , edges(2 ,k) , edges(3 ,k) , edges(4 ,k) , edges(5 ,k) ,
+                                            edges(6,k) , edges(7,k) , edges(8 ,k) , edges(9 ,k) , edges(10,k) , edges(11,k) ,
+                                            grav , false , fw_h , fw_n , fw_t_L , fw_t_R );
+        out(0,k) = fw_h;
+        out(1,k) = fw_n;
+        out(2,k) = fw_t_L;
+        out(3,k) = fw_t_R;
+      });
+    }));
+
+    // Halo fills, per halo cell
+    long halo = 2L*hs*ny + 2L*hs*(nx+2*hs);
+    op.nx = nx;
+    op.ny = ny;
+    char const *bc_names[3] = { "boundaries_wall" , "boundaries_open" , "boundaries_periodic" };
+    int         bcs     [3] = { SpatialADER::BC_WALL , SpatialADER::BC_OPEN , SpatialADER::BC_PERIODIC };
+    for (int b=0; b < 3; b++) {
+      op.bc_x = bcs[b];
+      op.bc_y = bcs[b];
+      results.push_back( benchmark( bc_names[b] , halo , 0 , 16.*num_state , reps , [&] () {
+        op.apply_boundaries( state );
+      }));
+    }
+
+    std::cout << "ord " << ord << " , ngll " << ngll << " , " << n << " cells , " << reps << " runs of each kernel\n";
+    std::cout << std::left << std::setw(22) << "kernel" << std::right << std::setw(12) << "ns/cell"
+              << std::setw(12) << "fastest" << std::setw(10) << "ci95" << std::setw(12) << "flops/cell"
+              << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s" << "\n";
+    for (auto const &r : results) {
+      std::ostringstream line;
+      line << std::left << std::setw(22) << r.name << std::right << std::fixed << std::setprecision(2)
+           << std::setw(12) << r.median  * 1.e9 / r.cells << std::setw(12) << r.fastest * 1.e9 / r.cells
+           << std::setw(9)  << r.ci95 * 100 << "%" << std::setprecision(0) << std::setw(12) << r.flops
+           << std::setprecision(2) << std::setw(10);
+      if (r.flops > 0) { line << r.flops * r.cells / r.median * 1.e-9; } else { line << "-"; }
+      line << std::setw(10) << r.bytes * r.cells / r.median * 1.e-9 << "\n";
+      std::cout << line.str();
+    }
+    Result const &rk   = results[3];
+    Result const &ader = results[4];
+    std::cout << "ADER time derivatives and average (cell_limits_ader - cell_limits_rk): " << std::fixed
+              << std::setprecision(2) << (ader.median - rk.median) * 1.e9 / n << " ns/cell\n";
+
+    if (! json_file.empty()) {
+      std::ofstream json( json_file );
+      if (! json) { endrun( "ERROR: Unable to open " + json_file ); }
+      json << std::setprecision(9);
+      json << "{\n  \"ord\": " << ord << ",\n  \"ngll\": " << ngll << ",\n  \"cells\": " << n
+           << ",\n  \"reps\": " << reps << ",\n  \"kernels\": {\n";
+      for (int k=0; k < (int) results.size(); k++) {
+        Result const &r = results[k];
+        json << "    \"" << r.name << "\": { \"ns_per_cell\": " << r.median * 1.e9 / r.cells
+             << ", \"fastest_ns_per_cell\": " << r.fastest * 1.e9 / r.cells << ", \"ci95\": " << r.ci95
+             << ", \"gflops\": " << r.flops * r.cells / r.median * 1.e-9
+             << ", \"gbytes\": " << r.bytes * r.cells / r.median * 1.e-9 << " }"
+             << (k+1 < (int) results.size() ? ",\n" : "\n");
+      }
+      json << "  }\n}\n";
+    }
+  }
+  yakl::finalize();
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+
+# Performance regression check of the driver. Runs a fixed matrix of small and medium configurations derived from
+# inputs/input_swm2d.yaml (1D and 2D, dimensionally split and unsplit, each time integrator, and with --mpi 1 and
+# 4 ranks), takes each run's cell updates per second at its median step time from the driver's summary_file,
+# which is steadier than the mean on a shared machine, and compares the median of --repeats runs against the
+# committed baseline. A configuration slower than its baseline by more than the
+# tolerance fails the check. Only the standard library is used, and nothing leaves the machine.
+#
+# The drivers are the perf_driver_<scheme>[_ord1] targets of CMakeLists.txt, one per time integrator and order,
+# and "make perf" builds them and runs this script. Baselines are only meaningful on the machine and build they
+# were measured with, so after a deliberate change in performance, or on a new machine, regenerate them with
+# --update.
+#
+# Usage: perf_regression.py --bin-dir <build dir> [--baseline file] [--mpi] [--mpirun cmd] [--repeats N]
+#                           [--tolerance frac] [--only regex] [--results file] [--update] [--list]
+
+import argparse
+import json
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+
+here    = os.path.dirname(os.path.abspath(__file__))
+schemes = ["ssprk3", "ssprk10_4", "ader"]
+
+# Settings of each problem on top of inputs/input_swm2d.yaml. A value of None removes the key. Sweeps skipping
+# resting tiles would make the work depend on the data, so rest_tol is removed, and sim_time gives 10 to 100
+# steps. out_freq is past sim_time, so only the initial and final states are written, outside the timed steps.
+# The unsplit tendencies only exist for ORD == 1 (and without MPI), so those problems run the perf_driver_*_ord1
+# builds and only dimensionally split problems run on 4 ranks.
+lake_2d  = dict(init_data="lake_at_rest_pert_2d", xlen=2, ylen=1, bc_x="open", bc_y="open")
+problems = [
+  # name              driver suffix  settings
+  ("1d"               , ""     , dict(init_data="dam_rect_1d", nx_glob=2048, ny_glob=1, xlen=1500, ylen=1,
+                                    bc_x="open", bc_y="open", sim_time=1    )),
+  ("2d_split_small"   , ""     , dict(lake_2d, nx_glob=64 , ny_glob=32 , dimsplit=True , sim_time=0.15 )),
+  ("2d_split_medium"  , ""     , dict(lake_2d, nx_glob=256, ny_glob=128, dimsplit=True , sim_time=0.012)),
+  ("2d_unsplit_small" , "_ord1", dict(lake_2d, nx_glob=64 , ny_glob=32 , dimsplit=False, sim_time=0.3  )),
+  ("2d_unsplit_medium", "_ord1", dict(lake_2d, nx_glob=256, ny_glob=128, dimsplit=False, sim_time=0.05 )),
+]
+common       = dict(rest_tol=None, out_freq=1000, progress_interval=0, nproc_x=1, nproc_y=1)
+mpi_problems = ["2d_split_medium"]
+
+
+# Every configuration as (name, driver, ranks, settings)
+def configurations():
+  configs = []
+  for scheme in schemes:
+    for problem, suffix, settings in problems:
+      driver = "perf_driver_" + scheme + suffix
+      configs.append(("%s_%s" % (problem, scheme), driver, 1, dict(common, **settings)))
+      if problem in mpi_problems:
+        configs.append(("%s_%s_mpi4" % (problem, scheme), driver, 4, dict(common, **dict(settings, nproc_x=2,
+                                                                                           nproc_y=2))))
+  return configs
+
+
+def yaml_value(value):
+  if isinstance(value, bool): return "true" if value else "false"
+  return str(value)
+
+
+# inputs/input_swm2d.yaml with the given keys replaced, removed, or added
+def input_file(settings):
+  settings = dict(settings)
+  lines    = []
+  with open(os.path.join(here, "..", "inputs", "input_swm2d.yaml")) as f:
+    for line in f:
+      match = re.match(r"^(\w+)\s*:", line)
+      if match and match.group(1) in settings:
+        value = settings.pop(match.group(1))
+        if value is not None: lines.append("%s : %s\n" % (match.group(1), yaml_value(value)))
+      else:
+        lines.append(line)
+  for key, value in settings.items():
+    if value is not None: lines.append("%s : %s\n" % (key, yaml_value(value)))
+  return "".join(lines)
+
+
+# The driver's summary of one run of a configuration in a scratch directory
+def run(args, driver, ranks, settings, work):
+  summary = os.path.join(work, "summary.json")
+  if os.path.exists(summary): os.remove(summary)
+  with open(os.path.join(work, "input.yaml"), "w") as f:
+    f.write(input_file(dict(settings, out_file=os.path.join(work, "out.nc"), summary_file=summary)))
+  cmd = [os.path.join(os.path.abspath(args.bin_dir), driver), "input.yaml"]
+  if args.mpi: cmd = shlex.split(args.mpirun) + ["-np", str(ranks)] + cmd
+  try:
+    proc = subprocess.run(cmd, cwd=work, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True, timeout=args.timeout)
+  except subprocess.TimeoutExpired:
+    return None, "timed out after %d s" % args.timeout
+  if proc.returncode != 0 or not os.path.exists(summary):
+    return None, "exited with %d:\n%s" % (proc.returncode, "\n".join(proc.stdout.splitlines()[-20:]))
+  with open(summary) as f:
+    summary = json.load(f)
+  summary["throughput"] = summary["cell_updates_per_step"] / max(summary["step_time"]["p50"], 1.e-9)
+  return summary, None
+
+
+def machine():
+  model = "unknown"
+  try:
+    with open("/proc/cpuinfo") as f:
+      for line in f:
+        if line.startswith("model name"):
+          model = line.split(":", 1)[1].strip()
+          break
+  except IOError:
+    pass
+  return "%s, %d cpus" % (model, os.cpu_count() or 1)
+
+
+def main():
+  parser = argparse.ArgumentParser(description="Check the driver's throughput against a stored baseline")
+  parser.add_argument("--bin-dir"  , default=".", help="directory of the perf_driver_* executables")
+  parser.add_argument("--baseline" , default=os.path.join(here, "perf_baseline.json"))
+  parser.add_argument("--mpi"      , action="store_true", help="drivers built with MPI: launch every run with "
+                                                                "--mpirun and include the 4-rank configurations")
+  parser.add_argument("--mpirun"   , default="mpirun", help="MPI launcher command, before -np")
+  parser.add_argument("--repeats"  , type=int  , default=5, help="runs of each configuration, keeping the median")
+  parser.add_argument("--tolerance", type=float, help="allowed slowdown as a fraction, overriding the baseline's")
+  parser.add_argument("--timeout"  , type=int  , default=600, help="seconds allowed for each run")
+  parser.add_argument("--only"     , help="only run configurations whose names match this regular expression")
+  parser.add_argument("--results"  , help="write the measured throughput to this JSON file")
+  parser.add_argument("--update"   , action="store_true", help="store the measured throughput as the baseline")
+  parser.add_argument("--list"     , action="store_true", help="list the configurations and exit")
+  args = parser.parse_args()
+
+  configs = [c for c in configurations() if (args.mpi or c[2] == 1) and (not args.only or re.search(args.only, c[0]))]
+  if args.list:
+    for name, driver, ranks, settings in configs: print(name)
+    return 0
+
+  baseline = {"tolerance": 0.15, "configs": {}}
+  if os.path.exists(args.baseline):
+    with open(args.baseline) as f: baseline = json.load(f)
+  if baseline.get("machine"          , machine()) != machine():
+    print("WARNING: The baseline was measured on %s, not this machine's %s" % (baseline["machine"], machine()))
+
+  print("%-32s %14s %14s %8s  %s" % ("configuration"    , "baseline", "measured", "change", "status"))
+  results  = {}
+  failures = 0
+  work     = tempfile.mkdtemp(prefix="perf_regression_")
+  for name, driver, ranks, settings in configs:
+    runs  = []
+    error = None
+    for rep in range(args.repeats):
+      summary, error = run(args, driver, ranks, settings, work)
+      if error: break
+      runs.append(summary)
+    if error:
+      failures += 1
+      print("%-32s %14s %14s %8s  FAILED: %s" % (name, "", "", "", error))
+      continue
+    runs.sort(key=lambda summary: summary["throughput"])
+    median   = runs[len(runs) // 2]
+    measured = median["throughput"]
+    results[name] = {"cell_updates_per_second": measured, "steps": median["steps"],
+                     "step_time_p50": median["step_time"]["p50"]}
+    base = baseline["configs"].get(name)
+    if base is None:
+      print("%-32s %14s %14.4g %8s  new" % (name, "-", measured, ""))
+      continue
+    tolerance = args.tolerance if args.tolerance is not None else base.get("tolerance"        , baseline["tolerance"])
+    change    = measured / base["cell_updates_per_second"] - 1
+    if change < -tolerance:
+      status    = "SLOWER (tolerance %g%%)" % (100 * tolerance)
+      failures += 1
+    elif change > tolerance:
+      status = "faster, consider --update"
+    else:
+      status = "ok"
+    print("%-32s %14.4g %14.4g %7.1f%%  %s" % (name, base["cell_updates_per_second"], measured, 100 * change,
+                                               status))
+  shutil.rmtree(work)
+
+  if args.results:
+    with open(args.results, "w") as f:
+      json.dump({"machine": machine(), "configs": results}, f, indent=2, sort_keys=True)
+  if args.update:
+    for name, result in results.items():
+      entry = baseline["configs"].setdefault(name, {})
+      entry["cell_updates_per_second"] = float("%.4g" % result["cell_updates_per_second"])
+    baseline["machine"] = machine()
+    with open(args.baseline, "w") as f:
+      json.dump(baseline, f, indent=2, sort_keys=True)
+      f.write("\n")
+    print("Updated %d configurations in %s" % (len(results), args.baseline))
+    return 0 if len(results) == len(configs) else 1
+
+  if failures:
+    print("%d of %d configurations failed or slowed down beyond tolerance" % (failures, len(configs)))
+    return 1
+  print("All %d configurations are within tolerance" % len(configs))
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
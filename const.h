@@ -4,6 +4,7 @@
 #include "YAKL.h"
 #include "yaml-cpp/yaml.h"
 #include <iostream>
+#include <vector>
 #include <assert.h>
 #include <chrono>
 #if __ENABLE_MPI__
@@ -31,7 +32,25 @@ using yakl::memset;
   #define NGLL 3
 #endif
 
-typedef double real;
+// Number of cells along a row handled by one thread in a dimensionally split sweep
+#ifndef SWEEP_TILE
+  #define SWEEP_TILE 32
+#endif
+
+// Number of passive tracers carried as h*c after the height and velocities
+#ifndef NUM_TRACERS
+  #define NUM_TRACERS 0
+#endif
+
+// Define MIXED_PREC to store the model's arrays in single precision. Operations that are sensitive to
+// round-off keep double precision through real_acc: the WENO total variation and weights, the ADER
+// Taylor series sums, and the global reductions for the time step, mass, and statistics
+#ifdef MIXED_PREC
+  typedef float  real;
+#else
+  typedef double real;
+#endif
+typedef double real_acc;
 
 YAKL_INLINE real constexpr operator"" _fp( long double x ) {
   return static_cast<real>(x);
@@ -46,6 +65,15 @@ typedef yakl::Array<real,6,yakl::memDevice,yakl::styleC> real6d;
 typedef yakl::Array<real,7,yakl::memDevice,yakl::styleC> real7d;
 typedef yakl::Array<real,8,yakl::memDevice,yakl::styleC> real8d;
 
+typedef yakl::Array<real_acc,1,yakl::memDevice,yakl::styleC> real_acc1d;
+typedef yakl::Array<real_acc,2,yakl::memDevice,yakl::styleC> real_acc2d;
+typedef yakl::Array<real_acc,3,yakl::memDevice,yakl::styleC> real_acc3d;
+
+typedef yakl::Array<int,2,yakl::memDevice,yakl::styleC> int2d;
+
+typedef yakl::Array<float,3,yakl::memDevice,yakl::styleC> float3d;
+typedef yakl::Array<float,3,yakl::memHost  ,yakl::styleC> floatHost3d;
+
 typedef yakl::Array<real,1,yakl::memHost,yakl::styleC> realHost1d;
 typedef yakl::Array<real,2,yakl::memHost,yakl::styleC> realHost2d;
 typedef yakl::Array<real,3,yakl::memHost,yakl::styleC> realHost3d;
@@ -57,6 +85,8 @@ typedef yakl::Array<real,8,yakl::memHost,yakl::styleC> realHost8d;
 
 int constexpr ord  = ORD;
 int constexpr ngll = NGLL;
+int constexpr sweep_tile = SWEEP_TILE;
+int constexpr num_tracers = NUM_TRACERS;
 
 static_assert(ngll <= ord , "ERROR: ngll must be <= ord");
 
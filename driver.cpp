@@ -1,7 +1,17 @@
 
 #include "const.h"
-#include "Temporal_ssprk3.h"
+// Time integrator: SSPRK3 by default, or define TEMPORAL_SSPRK10_4 or TEMPORAL_ADER
+#if defined(TEMPORAL_ADER)
+  #include "Temporal_ader.h"
+#elif defined(TEMPORAL_SSPRK10_4)
+  #include "Temporal_ssprk10_4.h"
+#else
+  #include "Temporal_ssprk3.h"
+#endif
 #include "Spatial_swm2d_fv_Agrid.h"
+#include "Nest.h"
+#include "Checkpoint.h"
+#include "RunStats.h"
 
 typedef Spatial_operator<time_avg,nAder> Spatial;
 
@@ -12,7 +22,9 @@ int main(int argc, char** argv) {
   {
     bool masterproc = true;
     #if __ENABLE_MPI__
-      int ierr = MPI_Init( &argc , &argv );
+      // The background writer of async_output makes MPI calls while the model steps on
+      int provided;
+      int ierr = MPI_Init_thread( &argc , &argv , MPI_THREAD_MULTIPLE , &provided );
       int myrank;
       ierr = MPI_Comm_rank(MPI_COMM_WORLD,&myrank);
       if (myrank != 0) masterproc = false;
@@ -24,52 +36,128 @@ int main(int argc, char** argv) {
     if ( !config            ) { endrun("ERROR: Invalid YAML input file"); }
     if ( !config["sim_time"] ) { endrun("ERROR: no sim_time entry"); }
     if ( !config["out_freq"] ) { endrun("ERROR: no out_freq entry"); }
-    real sim_time = config["sim_time"].as<real>();
-    real out_freq = config["out_freq"].as<real>();
+    real_acc sim_time = config["sim_time"].as<real_acc>();
+    real_acc out_freq = config["out_freq"].as<real_acc>();
     real cfl      = config["cfl"     ].as<real>();
     int num_out = 0;
 
+    // Optional checkpoints every checkpoint_freq seconds to checkpoint_file, and restart from restart_file
+    real_acc    checkpoint_freq = 0;
+    std::string checkpoint_file = "checkpoint.bin";
+    std::string restart_file    = "";
+    bool        collective      = false;
+    if (config["checkpoint_freq"      ]) { checkpoint_freq = config["checkpoint_freq"      ].as<real_acc>(); }
+    if (config["checkpoint_file"      ]) { checkpoint_file = config["checkpoint_file"      ].as<std::string>(); }
+    if (config["restart_file"         ]) { restart_file    = config["restart_file"         ].as<std::string>(); }
+    if (config["checkpoint_collective"]) { collective      = config["checkpoint_collective"].as<bool>(); }
+    bool restart = ! restart_file.empty();
+
+    // Optional timeline of every timed region of the run, written to trace_file at the end
+    if (config["trace_file"]) {
+      long trace_max_events = 1000000;
+      if (config["trace_max_events"]) { trace_max_events = config["trace_max_events"].as<long>(); }
+      Timers::trace_start( config["trace_file"].as<std::string>() , trace_max_events );
+    }
+
     Model model;
 
     model.init(in_file);
 
     real3d state = model.create_state_arr();
 
-    model.init_state(state);
+    // Counters of the time loop, taken from the checkpoint when restarting
+    Checkpoint<Spatial>::Counters counters = { 0 , 0 , 0 };
+    if (restart) {
+      counters = Checkpoint<Spatial>::read( model , state , restart_file , collective );
+    } else {
+      model.init_state(state);
+    }
 
-    real etime = 0;
+    // Optional one-way nested grid, described by its own input file
+    bool nested = config["nest_file"].IsDefined();
+    Nest<Spatial> nest;
+    if (nested) {
+      std::string nest_restart = restart ? Checkpoint<Spatial>::file_with_tag(restart_file,"nest") : "";
+      nest.init( config["nest_file"].as<std::string>() , model.space_op , state , nest_restart , collective );
+    }
 
-    model.output( state , etime );
+    real_acc etime = counters.etime;
+    int      nstep = counters.nstep;
+    num_out        = counters.num_out;
+    int num_checkpoint = checkpoint_freq > 0 ? (int) (etime / checkpoint_freq + 1.e-13) : 0;
+
+    // Throughput of the run, counting the updates of the coarse grid's cells and not the nest's
+    Spatial const &space_op = model.space_op;
+    long cells = (long) space_op.nx_glob * space_op.ny_glob;
+    RunStats stats;
+    stats.init( config , cells , cells * Model::num_stages * space_op.num_split() , etime , sim_time );
+
+    // A restarted run appends to the output files of the run that wrote the checkpoint
+    if (! restart) {
+      model.output( state , etime );
+      if (nested) { nest.output( etime ); }
+    }
+    stats.end_output();
 
     std::chrono::duration<double,std::milli> timer;
     
-    int nstep = 0;
     while (etime < sim_time) {
       real dt = model.compute_time_step(cfl,state);
       if (etime + dt > sim_time) { dt = sim_time - etime; }
       yakl::fence();
       auto t1 = std::chrono::high_resolution_clock::now();
       model.time_step( state , dt );
+      if (nested) { nest.time_step( model.space_op , state , dt ); }
       auto t2 = std::chrono::high_resolution_clock::now();
       timer = timer + std::chrono::duration<double,std::milli>(t2-t1);
+      stats.end_step();
       etime += dt;
       if (etime / out_freq + 1.e-13 >= num_out+1) {
         model.output( state , etime );
+        if (nested) { nest.output( etime ); }
         if (masterproc) std::cout << "Etime , dt: " << etime << " , " << dt << "\n";
         num_out++;
       }
+      model.space_op.output_streams( state , etime );
+      if (nested) { nest.output_streams( etime ); }
+      model.space_op.sample_gauges( state , etime );
+      if (nested) { nest.sample_gauges( etime ); }
+      model.space_op.log_diagnostics( etime );
+      if (nested) { nest.log_diagnostics( etime ); }
       nstep++;
+      if (checkpoint_freq > 0 && etime / checkpoint_freq + 1.e-13 >= num_checkpoint+1 && etime < sim_time) {
+        counters = { etime , nstep , num_out };
+        // Queued outputs, the gauges' buffered samples and the logged diagnostics are written first, so a restart
+        // finds them all
+        model.space_op.flush_logs();
+        Checkpoint<Spatial>::write( model , state , checkpoint_file , collective , counters );
+        if (nested) { nest.checkpoint( Checkpoint<Spatial>::file_with_tag(checkpoint_file,"nest") , collective , counters ); }
+        if (masterproc) std::cout << "Checkpoint at etime: " << etime << "\n";
+        num_checkpoint++;
+      }
+      stats.end_output();
+      stats.progress( etime , nstep );
     }
 
     model.output( state , etime );
+    if (nested) { nest.output( etime ); }
 
     if (masterproc) std::cout << "Elapsed Time: " << etime << "\n";
     if (masterproc) std::cout << "Walltime: " << timer.count()/1000 << "\n";
 
     model.finalize(state);
+    if (nested) { nest.finalize(); }
+    stats.end_output();
+    stats.report();
+
+    TIMERS_REPORT( (long) model.space_op.nx * model.space_op.ny );
+    Timers::trace_write();
 
   }
   yakl::finalize();
+  #if __ENABLE_MPI__
+    MPI_Finalize();
+  #endif
 }
 
 